@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string_view>
+#include <utility>
+
+#include "csp/dispatcher.h"
+#include "csp/receiver.h"
+
+// Measures what a Dispatcher costs per message as it gets more handlers,
+// and what one ui frame costs to pump a state's handlers: through a `wait()`
+// chain rebuilt every frame, a Dispatcher built once, and an AnyDispatcher
+// member. Messages are sent and handled on one thread, so only the dispatch
+// and the queue itself are measured.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// A distinct message type per handler.
+template <std::size_t I>
+struct Tagged {
+  std::size_t value;
+};
+
+// As many handlers as a ui state has.
+constexpr std::size_t FRAME_HANDLERS = 5;
+
+auto usage(const char *program) -> int {
+  std::cerr << "Usage: " << program << " [--messages N]\n"
+            << "  --messages  messages and frames per measurement"
+               " (default 200000)\n";
+  return 2;
+}
+
+// Sends `messages` messages of the type of the last of `N` handlers, so
+// the lookup cannot stop early, and returns the time taken per message.
+template <std::size_t N>
+auto perMessage(std::size_t messages) -> double {
+  srun_gui::Receiver receiver;
+  auto sender = receiver.getSender();
+  std::size_t handled = 0;
+  auto dispatcher = [&]<std::size_t... I>(std::index_sequence<I...>) {
+    return receiver.dispatcher(srun_gui::on<Tagged<I>>(
+        [&handled](const Tagged<I> &) { ++handled; })...);
+  }(std::make_index_sequence<N>{});
+
+  const srun_gui::DrainBudget budget{.max_messages = messages};
+  auto round = [&] {
+    for (std::size_t i = 0; i < messages; ++i) {
+      sender->send(Tagged<N - 1>{i});
+    }
+    dispatcher.poll(budget);
+  };
+
+  // Warms up the envelope pool and the dispatch index.
+  round();
+  auto start = Clock::now();
+  round();
+  auto elapsed = Clock::now() - start;
+  if (handled != 2 * messages) {
+    std::cerr << "Lost messages with " << N << " handlers\n";
+    std::exit(1);
+  }
+  return std::chrono::duration<double, std::nano>(elapsed).count() /
+         static_cast<double>(messages);
+}
+
+// Runs `frames` frames of `pump`, each after sending `per_frame` messages,
+// and returns the time taken per frame.
+template <typename Pump>
+auto perFrame(srun_gui::Sender &sender, std::size_t frames,
+              std::size_t per_frame, Pump &&pump) -> double {
+  auto round = [&] {
+    for (std::size_t frame = 0; frame < frames; ++frame) {
+      for (std::size_t i = 0; i < per_frame; ++i) {
+        sender.send(Tagged<FRAME_HANDLERS - 1>{i});
+      }
+      pump();
+    }
+  };
+
+  round();
+  auto start = Clock::now();
+  round();
+  auto elapsed = Clock::now() - start;
+  return std::chrono::duration<double, std::nano>(elapsed).count() /
+         static_cast<double>(frames);
+}
+
+// Per frame cost of a rebuilt chain, a Dispatcher and an AnyDispatcher.
+auto frameCosts(std::size_t frames, std::size_t per_frame)
+    -> std::array<double, 3> {
+  srun_gui::Receiver receiver;
+  auto sender = receiver.getSender();
+  std::size_t handled = 0;
+  // A fresh handler each time, as a ui state writes them inline.
+  auto count = [&handled] { return [&handled](const auto &) { ++handled; }; };
+  const srun_gui::DrainBudget budget{.max_messages =
+                                         std::max<std::size_t>(per_frame, 1)};
+  static_assert(FRAME_HANDLERS == 5);
+
+  auto chain = [&] {
+    receiver.wait(budget)
+        .dispatch<Tagged<0>>(count())
+        .dispatch<Tagged<1>>(count())
+        .dispatch<Tagged<2>>(count())
+        .dispatch<Tagged<3>>(count())
+        .dispatch<Tagged<4>>(count());
+  };
+  auto dispatcher = receiver.dispatcher(
+      srun_gui::on<Tagged<0>>(count()), srun_gui::on<Tagged<1>>(count()),
+      srun_gui::on<Tagged<2>>(count()), srun_gui::on<Tagged<3>>(count()),
+      srun_gui::on<Tagged<4>>(count()));
+  srun_gui::AnyDispatcher any = receiver.dispatcher(
+      srun_gui::on<Tagged<0>>(count()), srun_gui::on<Tagged<1>>(count()),
+      srun_gui::on<Tagged<2>>(count()), srun_gui::on<Tagged<3>>(count()),
+      srun_gui::on<Tagged<4>>(count()));
+
+  std::array<double, 3> costs{
+      perFrame(*sender, frames, per_frame, chain),
+      perFrame(*sender, frames, per_frame,
+               [&] { dispatcher.poll(budget); }),
+      perFrame(*sender, frames, per_frame, [&] { any.poll(budget); })};
+  if (handled != 3 * 2 * frames * per_frame) {
+    std::cerr << "Lost messages while pumping frames\n";
+    std::exit(1);
+  }
+  return costs;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  std::size_t messages = 200000;
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    if (arg == "--messages" && i + 1 < argc) {
+      messages = std::max<std::size_t>(std::strtoul(argv[++i], nullptr, 10), 1);
+    } else {
+      return usage(argv[0]);
+    }
+  }
+
+  // Send, queue and dispatch; only the dispatch depends on the handlers.
+  std::printf("%-10s %12s\n", "handlers", "ns/message");
+  std::printf("%-10d %12.1f\n", 1, perMessage<1>(messages));
+  std::printf("%-10d %12.1f\n", 4, perMessage<4>(messages));
+  std::printf("%-10d %12.1f\n", 16, perMessage<16>(messages));
+  std::printf("%-10d %12.1f\n", 64, perMessage<64>(messages));
+
+  // A frame pumps one state's handlers, usually with nothing queued.
+  auto empty = frameCosts(messages, 0);
+  auto busy = frameCosts(messages, 1);
+  std::printf("\n%-14s %14s %14s\n", "frame pump", "empty ns/frame",
+              "1 msg ns/frame");
+  const std::array<const char *, 3> names{"wait() chain", "Dispatcher",
+                                          "AnyDispatcher"};
+  for (std::size_t i = 0; i < names.size(); ++i) {
+    std::printf("%-14s %14.1f %14.1f\n", names[i], empty[i], busy[i]);
+  }
+  return 0;
+}
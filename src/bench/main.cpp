@@ -0,0 +1,347 @@
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "common/msg.h"
+#include "csp/receiver.h"
+#include "imgui.h"
+#include "imgui_internal.h"
+#include "ui.h"
+
+// Drives srun_gui::Ui the way a user and the backend would, by pressing its
+// buttons and sending it scripted backend messages, against an ImGui context
+// with no platform or renderer backend. Reports what a frame of each state
+// costs. Everything runs on one thread, so a frame's wall time is its CPU
+// time.
+
+namespace {
+
+// Heap allocations of the calling thread, through new or ImGui.
+thread_local std::size_t allocations = 0;
+
+}  // namespace
+
+void *operator new(std::size_t size) {
+  ++allocations;
+  if (void *ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc{};
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+
+void operator delete(void *ptr, std::size_t /*size*/) noexcept {
+  std::free(ptr);
+}
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Frames each state draws before it is measured, so first-use allocations
+// and state transitions are not counted.
+constexpr std::size_t WARMUP_FRAMES = 30;
+
+struct Result {
+  double _median_us{};
+  double _p95_us{};
+  double _allocations{};
+  // Of bare ImGui frames drawn in between, with one empty window each.
+  double _bare_median_us{};
+  double _bare_p95_us{};
+};
+
+// A state's frame times as multiples of a bare ImGui frame's, so they carry
+// over between machines and build types, unlike absolute times.
+struct Baseline {
+  double _allocations{};
+  double _median{};
+  double _p95{};
+};
+
+auto usage(const char *program) -> int {
+  std::cerr << "Usage: " << program
+            << " [--frames N] [--baseline FILE] [--tolerance X] [--save FILE]\n"
+            << "  --baseline  fail if a state allocates more than its baseline"
+               " or is slower\n"
+            << "              than it times the tolerance (default 2.0)\n"
+            << "  --save      write the results as the new baseline\n";
+  return 2;
+}
+
+auto loadBaseline(const std::string &path)
+    -> std::map<std::string, Baseline, std::less<>> {
+  std::map<std::string, Baseline, std::less<>> baseline;
+  std::ifstream in{path};
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream fields{line};
+    std::string name;
+    Baseline base;
+    if (line.starts_with('#') ||
+        !(fields >> name >> base._allocations >> base._median >> base._p95)) {
+      continue;
+    }
+    baseline[name] = base;
+  }
+  return baseline;
+}
+
+class Harness {
+ public:
+  Harness() {
+    ImGui::SetAllocatorFunctions(
+        [](std::size_t size, void * /*user_data*/) {
+          ++allocations;
+          return std::malloc(size);
+        },
+        [](void *ptr, void * /*user_data*/) { std::free(ptr); });
+    ImGui::CreateContext();
+    ImGuiIO &io = ImGui::GetIO();
+    io.IniFilename = nullptr;
+    io.DisplaySize = ImVec2(1280, 720);
+    io.DeltaTime = 1.0F / 60.0F;
+    // No renderer takes the atlas, so it is built here once.
+    io.Fonts->Build();
+    ImGui::StyleColorsLight();
+  }
+
+  Harness(const Harness &) = delete;
+
+  Harness(Harness &&) noexcept = delete;
+
+  Harness &operator=(const Harness &) = delete;
+
+  Harness &operator=(Harness &&) noexcept = delete;
+
+  ~Harness() { ImGui::DestroyContext(); }
+
+  auto ui() -> srun_gui::Ui & { return _ui; }
+
+  auto backend() -> srun_gui::Sender & { return *_backend; }
+
+  // Presses the button `label` of `window` in the next frame, as a click
+  // would.
+  auto press(const char *window, const char *label) -> bool {
+    auto *found = ImGui::FindWindowByName(window);
+    if (found == nullptr) {
+      return false;
+    }
+
+    ImGui::ActivateItemByID(ImGui::GetIDWithSeed(label, nullptr, found->ID));
+    return true;
+  }
+
+  // Draws `frames` frames after the warmup, each followed by a bare frame
+  // so that both see the same machine; `before_frame` runs before each
+  // one, e.g. to send the ui a message.
+  auto measure(std::size_t frames,
+               const std::function<void(std::size_t)> &before_frame = nullptr)
+      -> Result {
+    auto draw_ui = [this] { _ui.action(); };
+    for (std::size_t i = 0; i < WARMUP_FRAMES; ++i) {
+      if (before_frame) {
+        before_frame(i);
+      }
+      frame(draw_ui);
+      frame(drawBare);
+    }
+
+    std::vector<double> times;
+    std::vector<double> bare_times;
+    times.reserve(frames);
+    bare_times.reserve(frames);
+    std::size_t total_allocations = 0;
+    for (std::size_t i = 0; i < frames; ++i) {
+      if (before_frame) {
+        before_frame(WARMUP_FRAMES + i);
+      }
+
+      auto start_allocations = allocations;
+      times.push_back(frame(draw_ui));
+      total_allocations += allocations - start_allocations;
+      bare_times.push_back(frame(drawBare));
+    }
+
+    std::ranges::sort(times);
+    std::ranges::sort(bare_times);
+    return Result{
+        ._median_us = times[times.size() / 2],
+        ._p95_us = times[times.size() * 95 / 100],
+        ._allocations = static_cast<double>(total_allocations) /
+                        static_cast<double>(frames),
+        ._bare_median_us = bare_times[bare_times.size() / 2],
+        ._bare_p95_us = bare_times[bare_times.size() * 95 / 100]};
+  }
+
+ private:
+  static auto drawBare() -> void {
+    ImGui::Begin("Bare", nullptr, ImGuiWindowFlags_NoTitleBar);
+    ImGui::End();
+  }
+
+  // Returns the frame time in microseconds.
+  template <typename Draw>
+  static auto frame(const Draw &draw) -> double {
+    auto start = Clock::now();
+    ImGui::NewFrame();
+    ImGui::SetNextWindowSize(ImGui::GetIO().DisplaySize, ImGuiCond_Always);
+    ImGui::SetNextWindowPos(ImVec2(0, 0), ImGuiCond_Always);
+    draw();
+    ImGui::Render();
+    return std::chrono::duration<double, std::micro>(Clock::now() - start)
+        .count();
+  }
+
+  srun_gui::Ui _ui;
+  std::unique_ptr<srun_gui::Sender> _backend{_ui.getSender()};
+};
+
+auto sampleInfo(std::size_t in_bytes) -> srun_gui::DrawInfo {
+  srun_gui::DrawInfo info;
+  info.finished = true;
+  info.user_info.username = "bench";
+  info.user_info.online_ip = "10.0.0.2";
+  info.user_info.mac = "00:11:22:33:44:55";
+  info.user_info.wallet_balance = 12.5;
+  info.user_info.sum_seconds = 3600;
+  info.user_info.in_bytes = in_bytes;
+  return info;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  std::size_t frames = 600;
+  std::string baseline_path;
+  std::string save_path;
+  double tolerance = 2.0;
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    if (i + 1 == argc) {
+      return usage(argv[0]);
+    }
+
+    if (arg == "--frames") {
+      frames = std::max<std::size_t>(std::strtoul(argv[++i], nullptr, 10), 1);
+    } else if (arg == "--baseline") {
+      baseline_path = argv[++i];
+    } else if (arg == "--tolerance") {
+      tolerance = std::strtod(argv[++i], nullptr);
+    } else if (arg == "--save") {
+      save_path = argv[++i];
+    } else {
+      return usage(argv[0]);
+    }
+  }
+
+  Harness harness;
+  auto &ui = harness.ui();
+  auto &backend = harness.backend();
+  std::vector<std::pair<std::string, Result>> results;
+
+  // drawIdle with a loaded config.
+  backend.send(srun_gui::DrawConfig{
+      .err_msg = std::nullopt,
+      .finished = true,
+      .config_file = "config.json",
+      .config = srun_gui::Config{.protocol = "http",
+                                 .host = "10.0.0.1",
+                                 .port = "80",
+                                 .username = "bench",
+                                 .password = "bench"}});
+  results.emplace_back("idle", harness.measure(frames));
+
+  // drawWait once Ready! starts the login.
+  if (!harness.press("Hello, world!", "Ready!")) {
+    std::cerr << "The ui did not draw its config\n";
+    return 1;
+  }
+  results.emplace_back("wait", harness.measure(frames));
+  if (!ui.animating()) {
+    std::cerr << "The ui did not wait for the login\n";
+    return 1;
+  }
+
+  // drawInfo once the login and the first info arrived.
+  backend.send(srun_gui::DrawLogin{.err_msg = std::nullopt,
+                                   .finished = true,
+                                   .username = "bench"});
+  backend.send(sampleInfo(0));
+  results.emplace_back("info", harness.measure(frames));
+  if (ui.userInfo().username != "bench") {
+    std::cerr << "The ui did not show the info\n";
+    return 1;
+  }
+
+  // drawInfo with a new result every frame.
+  results.emplace_back("info_updates",
+                       harness.measure(frames, [&backend](std::size_t i) {
+                         backend.send(sampleInfo(i + 1));
+                       }));
+
+  // Frames that get no messages have nothing to build, so they must not
+  // allocate at all, whatever the baseline says.
+  auto allocating_idle = false;
+  for (const auto &[name, result] : results) {
+    if (name != "info_updates" && result._allocations != 0) {
+      std::cerr << "The " << name << " state allocated "
+                << result._allocations << " times per frame without messages\n";
+      allocating_idle = true;
+    }
+  }
+
+  auto relative = [](const Result &result) {
+    return Baseline{._allocations = result._allocations,
+                    ._median = result._median_us / result._bare_median_us,
+                    ._p95 = result._p95_us / result._bare_p95_us};
+  };
+
+  auto baseline = loadBaseline(baseline_path);
+  auto regressed = false;
+  std::printf("%-14s %10s %10s %14s %12s\n", "state", "median us", "p95 us",
+              "allocs/frame", "x bare");
+  for (const auto &[name, result] : results) {
+    auto now = relative(result);
+    std::printf("%-14s %10.1f %10.1f %14.2f %5.2f/%5.2f", name.c_str(),
+                result._median_us, result._p95_us, result._allocations,
+                now._median, now._p95);
+    if (auto it = baseline.find(name); it != baseline.end()) {
+      const auto &base = it->second;
+      auto slower = base._median * tolerance < now._median ||
+                    base._p95 * tolerance < now._p95;
+      auto allocates = base._allocations < now._allocations;
+      std::printf("  baseline %.2f/%.2f, %.2f allocs%s", base._median,
+                  base._p95, base._allocations,
+                  slower || allocates ? "  REGRESSED" : "");
+      regressed = regressed || slower || allocates;
+    }
+    std::printf("\n");
+  }
+
+  if (!save_path.empty()) {
+    std::ofstream out{save_path};
+    out << "# state, allocations per frame, median and p95 frame time as\n"
+        << "# multiples of a bare ImGui frame's\n";
+    for (const auto &[name, result] : results) {
+      auto base = relative(result);
+      out << name << " " << base._allocations << " " << base._median << " "
+          << base._p95 << "\n";
+    }
+  }
+
+  return regressed || allocating_idle ? 1 : 0;
+}
@@ -0,0 +1,122 @@
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "csp/dispatcher.h"
+#include "csp/receiver.h"
+#include "csp/thread_safe_queue.h"
+
+// Pushes messages from several producer threads into one consumer, through
+// the lock-free MessageQueue behind Sender/Receiver and through the mutex
+// based ThreadSafeQueue it replaced, and reports the cost per message.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Payload {
+  std::uint64_t value;
+};
+
+auto usage(const char *program) -> int {
+  std::cerr << "Usage: " << program << " [--messages N]\n"
+            << "  --messages  messages per producer (default 200000)\n";
+  return 2;
+}
+
+// Starts `producers` threads running `produce(producer)` and returns how
+// long `consume` took to take all their messages.
+template <typename Produce, typename Consume>
+auto run(std::size_t producers, Produce &&produce, Consume &&consume)
+    -> Clock::duration {
+  std::vector<std::thread> threads;
+  auto start = Clock::now();
+  for (std::size_t i = 0; i < producers; ++i) {
+    threads.emplace_back([&produce, i] { produce(i); });
+  }
+  consume();
+  auto elapsed = Clock::now() - start;
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  return elapsed;
+}
+
+auto threadSafeQueue(std::size_t producers, std::size_t messages)
+    -> Clock::duration {
+  srun_gui::ThreadSafeQueue<std::unique_ptr<Payload>> queue;
+  return run(
+      producers,
+      [&](std::size_t /*producer*/) {
+        for (std::size_t i = 0; i < messages; ++i) {
+          queue.push(std::make_unique<Payload>(Payload{i}));
+        }
+      },
+      [&] {
+        std::unique_ptr<Payload> payload;
+        for (std::size_t i = 0; i < producers * messages; ++i) {
+          queue.waitAndPop(payload);
+        }
+      });
+}
+
+auto messageQueue(std::size_t producers, std::size_t messages)
+    -> Clock::duration {
+  srun_gui::Receiver receiver;
+  // One sender per thread, as Sender requires.
+  std::vector<std::unique_ptr<srun_gui::Sender>> senders;
+  for (std::size_t i = 0; i < producers; ++i) {
+    senders.push_back(receiver.getSender());
+  }
+
+  std::size_t received = 0;
+  auto dispatcher = receiver.dispatcher(
+      srun_gui::on<Payload>([&received](const Payload &) { ++received; }));
+  return run(
+      producers,
+      [&](std::size_t producer) {
+        for (std::size_t i = 0; i < messages; ++i) {
+          senders[producer]->send(Payload{i});
+        }
+      },
+      [&] {
+        while (received < producers * messages) {
+          dispatcher.wait();
+        }
+      });
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  std::size_t messages = 200000;
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    if (arg == "--messages" && i + 1 < argc) {
+      messages = std::max<std::size_t>(std::strtoul(argv[++i], nullptr, 10), 1);
+    } else {
+      return usage(argv[0]);
+    }
+  }
+
+  std::printf("%-10s %18s %18s\n", "producers", "ThreadSafeQueue ns",
+              "MessageQueue ns");
+  for (std::size_t producers : {1U, 2U, 4U, 8U}) {
+    auto per_message = [&](Clock::duration elapsed) {
+      return std::chrono::duration<double, std::nano>(elapsed).count() /
+             static_cast<double>(producers * messages);
+    };
+    std::printf("%-10zu %18.1f %18.1f\n", producers,
+                per_message(threadSafeQueue(producers, messages)),
+                per_message(messageQueue(producers, messages)));
+  }
+  return 0;
+}
@@ -0,0 +1,477 @@
+#if defined(__unix__) || defined(__APPLE__)
+#define SRUN_CLI_HAS_SIGWAIT 1
+#include <pthread.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "common/msg.h"
+#include "control_socket.h"
+#include "csp/dispatcher.h"
+#include "csp/receiver.h"
+#include "srun_backend.h"
+
+namespace {
+
+using srun_gui::on;
+
+#if defined(SRUN_CLI_HAS_SIGWAIT)
+
+auto interruptSignals() -> sigset_t {
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  return signals;
+}
+
+// Before any thread starts, so every thread inherits the mask and only
+// Interrupts takes the signals.
+auto setUpInterrupts() -> void {
+  auto signals = interruptSignals();
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+}
+
+// Runs `on_interrupt` on its own thread for every SIGINT or SIGTERM, so
+// nothing has to wake up to look for them.
+class Interrupts {
+ public:
+  explicit Interrupts(std::function<void()> on_interrupt)
+      : _thread{[this, on_interrupt = std::move(on_interrupt)] {
+          auto signals = interruptSignals();
+          for (;;) {
+            int signal = 0;
+            sigwait(&signals, &signal);
+            if (_stop) {
+              return;
+            }
+            on_interrupt();
+          }
+        }} {}
+
+  Interrupts(const Interrupts &) = delete;
+
+  Interrupts(Interrupts &&) noexcept = delete;
+
+  Interrupts &operator=(const Interrupts &) = delete;
+
+  Interrupts &operator=(Interrupts &&) noexcept = delete;
+
+  ~Interrupts() {
+    _stop = true;
+    pthread_kill(_thread.native_handle(), SIGTERM);
+    _thread.join();
+  }
+
+ private:
+  std::atomic<bool> _stop{false};
+  std::thread _thread;
+};
+
+#else
+
+std::atomic<bool> interrupted{false};
+
+extern "C" void onSignal(int /*signal*/) { interrupted = true; }
+
+auto setUpInterrupts() -> void {
+  std::signal(SIGINT, onSignal);
+  std::signal(SIGTERM, onSignal);
+}
+
+// Without sigwait a handler can only set a flag, so it is looked at every
+// TICK instead.
+class Interrupts {
+ public:
+  explicit Interrupts(std::function<void()> on_interrupt)
+      : _thread{[this, on_interrupt = std::move(on_interrupt)] {
+          constexpr auto TICK = std::chrono::milliseconds{100};
+          while (!_stop) {
+            if (interrupted.exchange(false)) {
+              on_interrupt();
+            }
+            std::this_thread::sleep_for(TICK);
+          }
+        }} {}
+
+  Interrupts(const Interrupts &) = delete;
+
+  Interrupts(Interrupts &&) noexcept = delete;
+
+  Interrupts &operator=(const Interrupts &) = delete;
+
+  Interrupts &operator=(Interrupts &&) noexcept = delete;
+
+  ~Interrupts() {
+    _stop = true;
+    _thread.join();
+  }
+
+ private:
+  std::atomic<bool> _stop{false};
+  std::thread _thread;
+};
+
+#endif
+
+auto usage(const char *program) -> int {
+  std::cerr << "Usage: " << program
+            << " [-c config.json] [-a name=config.json]... <command>\n"
+            << "  -a      also run the command for this account\n"
+            << "Commands:\n"
+            << "  login   log in and exit\n"
+            << "  info    print the user info and exit\n"
+            << "  logout  log out and exit\n"
+            << "  daemon  log in and stay online until interrupted\n";
+  return 2;
+}
+
+// A SessionManager account, see `-a`.
+struct Account {
+  std::string name;
+  std::string config_file;
+};
+
+auto printAccount(const std::string &account, const srun_gui::DrawLogin &msg)
+    -> void {
+  std::cout << account << ": " << msg.username << " is online\n";
+}
+
+auto printAccount(const std::string &account, const srun_gui::DrawInfo &msg)
+    -> void {
+  const auto &info = msg.user_info;
+  std::cout << account << ": " << info.username << " at " << info.online_ip
+            << ", " << info.in_bytes << " bytes in, " << info.out_bytes
+            << " bytes out\n";
+}
+
+auto printAccount(const std::string &account,
+                  const srun_gui::DrawLogout & /*msg*/) -> void {
+  std::cout << account << ": logged out\n";
+}
+
+// Pumps `dispatcher` until `done` is set. Returns false once `ui` is
+// closed, which an interrupt does.
+template <typename Dispatcher>
+auto pumpUntil(const srun_gui::Receiver &ui, Dispatcher &dispatcher,
+               const bool &done) -> bool {
+  while (!done) {
+    if (ui.closed()) {
+      return false;
+    }
+
+    dispatcher.wait();
+  }
+  return true;
+}
+
+// Runs the backend on its own thread, the way srun_gui does, and plays the
+// ui's part on the calling thread.
+class Cli {
+ public:
+  Cli(bool keep_alive, std::vector<Account> accounts)
+      : _accounts{std::move(accounts)} {
+    const auto watchdog = srun_gui::WatchdogOptions{.enabled = keep_alive};
+    _backend.setUi(
+        [this] { return _ui.getSender(); },
+        srun_gui::SessionOptions{
+            .threads = std::clamp<std::size_t>(_accounts.size(), 1, 4),
+            .watchdog = watchdog});
+    _backend.setWatchdogOptions(watchdog);
+  }
+
+  Cli(const Cli &) = delete;
+
+  Cli(Cli &&) noexcept = delete;
+
+  Cli &operator=(const Cli &) = delete;
+
+  Cli &operator=(Cli &&) noexcept = delete;
+
+  ~Cli() {
+    if (_thread.joinable()) {
+      _backend.getControlSender()->send(srun_gui::CloseQueueMsg{});
+      _thread.join();
+    }
+  }
+
+  // Before start.
+  auto addObserver(srun_gui::ControlSocket &control) {
+    _backend.addObserver([&control] { return control.getSender(); });
+  }
+
+  auto getSender() const { return _backend.getSender(); }
+
+  // Wakes and ends whatever waits for the backend. Safe from any thread.
+  auto interrupt() { _ui.close(); }
+
+  auto start() { _thread = std::thread{[this] { _backend.run(); }}; }
+
+  auto loadConfig(std::string_view config_file) -> bool {
+    auto done = false;
+    auto ok = false;
+    auto dispatcher = _ui.dispatcher(
+        on<srun_gui::DrawConfig>([&](const srun_gui::DrawConfig &msg) {
+          if (msg.err_msg.has_value()) {
+            std::cerr << "Config error: " << msg.err_msg.value() << "\n";
+          }
+          ok = msg.finished;
+          done = true;
+        }));
+    _srun->send(srun_gui::RequestLoadConfigFile{
+        .config_file = std::string{config_file}});
+    return pumpUntil(_ui, dispatcher, done) && ok;
+  }
+
+  // Waits until the backend took or refused every account.
+  auto addAccounts() -> bool {
+    auto pending = _accounts.size();
+    auto done = pending == 0;
+    auto ok = true;
+    auto dispatcher = _ui.dispatcher(
+        on<srun_gui::DrawAccount>([&](const srun_gui::DrawAccount &) {
+          done = --pending == 0;
+        }),
+        on<srun_gui::ErrMsg>([&](const srun_gui::ErrMsg &msg) {
+          std::cerr << "Error: " << msg.err_msg << "\n";
+          ok = false;
+          done = --pending == 0;
+        }));
+    for (const auto &account : _accounts) {
+      _srun->send(srun_gui::RequestAddAccountFile{
+          .account = account.name, .config_file = account.config_file});
+    }
+    return pumpUntil(_ui, dispatcher, done) && ok;
+  }
+
+  // Sends a `Request` for every account and waits for their `Update`s.
+  template <typename Request, typename Update>
+  auto forAccounts() -> bool {
+    auto pending = _accounts.size();
+    auto done = pending == 0;
+    auto ok = true;
+    auto finish = [&](bool success) {
+      ok = ok && success;
+      done = --pending == 0;
+    };
+    auto dispatcher = _ui.dispatcher(
+        on<srun_gui::DrawAccount>([&](const srun_gui::DrawAccount &msg) {
+          const auto *update = std::get_if<Update>(&msg.update);
+          if (update == nullptr) {
+            return;
+          }
+
+          if (update->err_msg.has_value()) {
+            std::cerr << msg.account << ": " << update->err_msg.value()
+                      << "\n";
+            finish(false);
+            return;
+          }
+
+          if (update->finished) {
+            printAccount(msg.account, *update);
+            finish(true);
+          }
+        }),
+        on<srun_gui::ErrMsg>([&](const srun_gui::ErrMsg &msg) {
+          std::cerr << "Error: " << msg.err_msg << "\n";
+          finish(false);
+        }));
+    for (const auto &account : _accounts) {
+      _srun->send(Request{.account = account.name, .cancel = {}});
+    }
+    return pumpUntil(_ui, dispatcher, done) && ok;
+  }
+
+  auto login() -> bool {
+    auto done = false;
+    auto ok = false;
+    auto dispatcher = _ui.dispatcher(
+        on<srun_gui::DrawLogin>([&](const srun_gui::DrawLogin &msg) {
+          if (msg.err_msg.has_value()) {
+            std::cerr << "Login failed: " << msg.err_msg.value() << "\n";
+            done = true;
+            return;
+          }
+
+          if (!msg.finished) {
+            return;
+          }
+
+          std::cout << msg.username << " is online\n";
+          ok = true;
+          done = true;
+        }));
+    _srun->send(srun_gui::RequestLogin{});
+    return pumpUntil(_ui, dispatcher, done) && ok;
+  }
+
+  auto info() -> bool {
+    auto done = false;
+    auto ok = false;
+    auto dispatcher = _ui.dispatcher(
+        on<srun_gui::DrawInfo>([&](const srun_gui::DrawInfo &msg) {
+          done = true;
+          if (msg.err_msg.has_value()) {
+            std::cerr << "Info failed: " << msg.err_msg.value() << "\n";
+            return;
+          }
+
+          const auto &info = msg.user_info;
+          std::cout << "Username:       " << info.username << "\n"
+                    << "Online IP:      " << info.online_ip << "\n"
+                    << "MAC:            " << info.mac << "\n"
+                    << "Balance:        " << info.wallet_balance << "\n"
+                    << "Online seconds: " << info.sum_seconds << "\n"
+                    << "Bytes in:       " << info.in_bytes << "\n"
+                    << "Bytes out:      " << info.out_bytes << "\n"
+                    << "Devices:        " << info.online_device_info.size()
+                    << "\n";
+          ok = true;
+        }));
+    _srun->send(srun_gui::RequestInfo{});
+    return pumpUntil(_ui, dispatcher, done) && ok;
+  }
+
+  auto logout() -> bool {
+    auto done = false;
+    auto ok = false;
+    auto dispatcher = _ui.dispatcher(
+        on<srun_gui::DrawLogout>([&](const srun_gui::DrawLogout &msg) {
+          if (msg.err_msg.has_value()) {
+            std::cerr << "Logout failed: " << msg.err_msg.value() << "\n";
+          } else {
+            std::cout << "Logged out\n";
+          }
+          ok = msg.finished;
+          done = true;
+        }));
+    _srun->send(srun_gui::RequestLogout{});
+    return pumpUntil(_ui, dispatcher, done) && ok;
+  }
+
+  // The backend's watchdogs keep the sessions online; this only reports
+  // errors and re-logins of accounts until a signal arrives.
+  auto daemon() -> bool {
+    if (!login() ||
+        !forAccounts<srun_gui::RequestAccountLogin, srun_gui::DrawLogin>()) {
+      return false;
+    }
+
+    const auto never = false;
+    auto dispatcher = _ui.dispatcher(
+        on<srun_gui::ErrMsg>([](const srun_gui::ErrMsg &msg) {
+          std::cerr << "Error: " << msg.err_msg << "\n";
+        }),
+        on<srun_gui::DrawAccount>([](const srun_gui::DrawAccount &msg) {
+          const auto *login = std::get_if<srun_gui::DrawLogin>(&msg.update);
+          if (login == nullptr) {
+            return;
+          }
+
+          if (login->err_msg.has_value()) {
+            std::cerr << msg.account << ": " << login->err_msg.value()
+                      << "\n";
+          } else if (login->finished) {
+            printAccount(msg.account, *login);
+          }
+        }));
+    pumpUntil(_ui, dispatcher, never);
+
+    auto metrics = _backend.watchdogMetrics();
+    std::cout << "Session dropped " << metrics.drops << " times, recovered "
+              << metrics.recoveries << " times\n";
+    return true;
+  }
+
+ private:
+  std::vector<Account> _accounts;
+  srun_gui::Receiver _ui;
+  srun_gui::SrunBackend _backend;
+  std::unique_ptr<srun_gui::Sender> _srun{_backend.getSender()};
+  std::thread _thread;
+};
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  std::string config_file = "config.json";
+  std::vector<Account> accounts;
+  std::string_view command;
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    if (arg == "-c" && i + 1 < argc) {
+      config_file = argv[++i];
+    } else if (arg == "-a" && i + 1 < argc) {
+      std::string_view account = argv[++i];
+      auto eq = account.find('=');
+      if (eq == 0 || eq == std::string_view::npos) {
+        return usage(argv[0]);
+      }
+      accounts.push_back(Account{.name = std::string{account.substr(0, eq)},
+                                 .config_file = std::string{
+                                     account.substr(eq + 1)}});
+    } else if (command.empty()) {
+      command = arg;
+    } else {
+      return usage(argv[0]);
+    }
+  }
+
+  if (command != "login" && command != "info" && command != "logout" &&
+      command != "daemon") {
+    return usage(argv[0]);
+  }
+
+  setUpInterrupts();
+  Cli cli{command == "daemon", std::move(accounts)};
+  Interrupts interrupts{[&cli] { cli.interrupt(); }};
+  // A daemon is the running instance that scripts talk to.
+  srun_gui::ControlSocket control;
+  if (command == "daemon") {
+    switch (control.start(cli.getSender())) {
+      case srun_gui::ControlSocket::Status::AlreadyRunning:
+        std::cerr << "Already running, see " << control.path() << "\n";
+        return 1;
+      case srun_gui::ControlSocket::Status::Failed:
+        std::cerr << "No control socket at " << control.path() << "\n";
+        break;
+      case srun_gui::ControlSocket::Status::Started:
+        cli.addObserver(control);
+        break;
+    }
+  }
+
+  cli.start();
+  if (!cli.loadConfig(config_file) || !cli.addAccounts()) {
+    return 1;
+  }
+
+  auto ok = false;
+  if (command == "login") {
+    ok = cli.login() && cli.forAccounts<srun_gui::RequestAccountLogin,
+                                        srun_gui::DrawLogin>();
+  } else if (command == "info") {
+    ok = cli.info() && cli.forAccounts<srun_gui::RequestAccountInfo,
+                                       srun_gui::DrawInfo>();
+  } else if (command == "logout") {
+    ok = cli.logout() && cli.forAccounts<srun_gui::RequestAccountLogout,
+                                         srun_gui::DrawLogout>();
+  } else {
+    ok = cli.daemon();
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,535 @@
+#include "control_socket.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SRUN_GUI_HAS_CONTROL_SOCKET 1
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <sstream>
+#include <type_traits>
+#include <variant>
+
+#include "csp/dispatcher.h"
+
+namespace srun_gui {
+
+#if defined(SRUN_GUI_HAS_CONTROL_SOCKET)
+
+namespace {
+
+// Longer lines are not commands; the client is dropped.
+constexpr std::size_t MAX_LINE = 1024;
+
+#if defined(MSG_NOSIGNAL)
+constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+constexpr int SEND_FLAGS = 0;
+#endif
+
+auto setNonBlocking(int fd) {
+  ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+  return ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK) == 0;
+}
+
+// Clients that cannot keep up are dropped rather than stalling the others.
+auto writeLine(int fd, std::string line) -> bool {
+  line += '\n';
+  auto n = ::send(fd, line.data(), line.size(), SEND_FLAGS);
+  return n == static_cast<ssize_t>(line.size());
+}
+
+auto infoFields(const UserInfo& info) -> std::string {
+  std::ostringstream out;
+  out << "username=" << info.username << " online_ip=" << info.online_ip
+      << " mac=" << info.mac << " balance=" << info.wallet_balance
+      << " remain_seconds=" << info.remain_seconds
+      << " sum_seconds=" << info.sum_seconds << " in_bytes=" << info.in_bytes
+      << " out_bytes=" << info.out_bytes
+      << " remain_bytes=" << info.remain_bytes
+      << " sum_bytes=" << info.sum_bytes
+      << " devices=" << info.online_device_info.size();
+  return out.str();
+}
+
+// The event line for a report; empty for progress nobody waits for.
+auto eventLine(const DrawLogin& msg) -> std::string {
+  if (msg.err_msg.has_value()) {
+    return "login error " + msg.err_msg.value();
+  }
+
+  return (msg.finished ? "login online " : "login pending ") + msg.username;
+}
+
+auto eventLine(const DrawInfo& msg) -> std::string {
+  if (msg.err_msg.has_value()) {
+    return "info error " + msg.err_msg.value();
+  }
+
+  return msg.finished ? "info ok " + infoFields(msg.user_info) : "";
+}
+
+auto eventLine(const DrawLogout& msg) -> std::string {
+  if (msg.err_msg.has_value()) {
+    return "logout error " + msg.err_msg.value();
+  }
+
+  return msg.finished ? "logout ok" : "";
+}
+
+// What `accounts` reports for an account after `update`; empty if it
+// stays as it was.
+auto accountState(const DrawLogin& msg) -> std::string {
+  if (msg.err_msg.has_value()) {
+    return "error";
+  }
+
+  return msg.finished ? "online" : "";
+}
+
+auto accountState(const DrawInfo& msg) -> std::string {
+  if (msg.err_msg.has_value()) {
+    return "error";
+  }
+
+  return msg.finished ? "online" : "";
+}
+
+auto accountState(const DrawLogout& msg) -> std::string {
+  if (msg.err_msg.has_value()) {
+    return "error";
+  }
+
+  return msg.finished ? "offline" : "";
+}
+
+// Splits off the first word of `line`.
+auto nextWord(std::string_view& line) -> std::string_view {
+  auto end = std::min(line.find(' '), line.size());
+  auto word = line.substr(0, end);
+  line.remove_prefix(std::min(end + 1, line.size()));
+  return word;
+}
+
+}  // namespace
+
+// The event queue's waker shares it, so the pipe stays open for as long as
+// a sender may still wake it, even after the socket is gone.
+struct ControlSocket::WakePipe {
+  WakePipe() {
+    if (::pipe(_fds) != 0) {
+      return;
+    }
+
+    if (!setNonBlocking(_fds[0]) || !setNonBlocking(_fds[1])) {
+      ::close(_fds[0]);
+      ::close(_fds[1]);
+      _fds[0] = -1;
+      _fds[1] = -1;
+    }
+  }
+
+  WakePipe(const WakePipe&) = delete;
+
+  WakePipe(WakePipe&&) noexcept = delete;
+
+  WakePipe& operator=(const WakePipe&) = delete;
+
+  WakePipe& operator=(WakePipe&&) noexcept = delete;
+
+  ~WakePipe() {
+    if (0 <= _fds[0]) {
+      ::close(_fds[0]);
+      ::close(_fds[1]);
+    }
+  }
+
+  auto fd() const { return _fds[0]; }
+
+  // One byte is in the pipe until the socket thread takes it.
+  auto wake() -> void {
+    if (_fds[1] < 0 || _pending.exchange(true, std::memory_order_acq_rel)) {
+      return;
+    }
+
+    char byte = 0;
+    [[maybe_unused]] auto n = ::write(_fds[1], &byte, 1);
+  }
+
+  // Before the socket thread looks at the events, so a report arriving
+  // after it looked writes again.
+  auto clear() -> void {
+    char buffer[16];
+    while (0 < ::read(_fds[0], buffer, sizeof(buffer))) {
+    }
+    _pending.store(false, std::memory_order_release);
+  }
+
+  int _fds[2]{-1, -1};
+  std::atomic<bool> _pending{false};
+};
+
+ControlSocket::ControlSocket(std::string path)
+    : _path{std::move(path)}, _wake{std::make_shared<WakePipe>()} {
+  _events.setWaker([wake = _wake] { wake->wake(); });
+}
+
+ControlSocket::~ControlSocket() {
+  _stop = true;
+  // Closing wakes the socket thread, and later reports are refused.
+  _events.close();
+  if (_thread.joinable()) {
+    _thread.join();
+  }
+
+  for (const auto& client : _clients) {
+    ::close(client._fd);
+  }
+
+  if (0 <= _listen_fd) {
+    ::close(_listen_fd);
+    ::unlink(_path.c_str());
+  }
+
+  // The lock file stays; removing it would race with the next instance.
+  if (0 <= _lock_fd) {
+    ::close(_lock_fd);
+  }
+}
+
+auto ControlSocket::defaultPath() -> std::string {
+  if (const auto* dir = std::getenv("XDG_RUNTIME_DIR");
+      dir != nullptr && *dir != '\0') {
+    return std::string{dir} + "/srun_gui.sock";
+  }
+
+  return "/tmp/srun_gui-" + std::to_string(::getuid()) + ".sock";
+}
+
+auto ControlSocket::start(std::unique_ptr<Sender> srun,
+                          std::unique_ptr<Sender> window) -> Status {
+  sockaddr_un addr{};
+  if (sizeof(addr.sun_path) <= _path.size() || _wake->fd() < 0) {
+    return Status::Failed;
+  }
+
+  // The kernel releases the lock with its process, so a crashed instance
+  // never blocks the next one; its stale socket file is replaced below.
+  // In a shared directory like /tmp, another user could have planted the
+  // lock file or a link in its place.
+  auto lock_path = _path + ".lock";
+  _lock_fd = ::open(lock_path.c_str(),
+                    O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600);
+  if (_lock_fd < 0) {
+    return Status::Failed;
+  }
+
+  struct stat lock_stat {};
+  if (::fstat(_lock_fd, &lock_stat) != 0 || !S_ISREG(lock_stat.st_mode) ||
+      lock_stat.st_uid != ::getuid()) {
+    ::close(_lock_fd);
+    _lock_fd = -1;
+    return Status::Failed;
+  }
+
+  if (::flock(_lock_fd, LOCK_EX | LOCK_NB) != 0) {
+    auto busy = errno == EWOULDBLOCK;
+    ::close(_lock_fd);
+    _lock_fd = -1;
+    return busy ? Status::AlreadyRunning : Status::Failed;
+  }
+
+  ::unlink(_path.c_str());
+  _listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (_listen_fd < 0) {
+    return Status::Failed;
+  }
+
+  addr.sun_family = AF_UNIX;
+  std::ranges::copy(_path, addr.sun_path);
+  if (!setNonBlocking(_listen_fd) ||
+      ::bind(_listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) !=
+          0 ||
+      ::chmod(_path.c_str(), 0600) != 0 || ::listen(_listen_fd, 8) != 0) {
+    ::close(_listen_fd);
+    _listen_fd = -1;
+    return Status::Failed;
+  }
+
+  _srun = std::move(srun);
+  _window = std::move(window);
+  _thread = std::thread{[this] { loop(); }};
+  return Status::Started;
+}
+
+auto ControlSocket::loop() -> void {
+  auto events = _events.dispatcher(
+      on<DrawLogin>([this](const DrawLogin& msg) {
+        if (msg.finished && !msg.err_msg.has_value()) {
+          _known = true;
+          _online = true;
+          _username = msg.username;
+        }
+        broadcast(eventLine(msg));
+      }),
+      on<DrawInfo>([this](const DrawInfo& msg) {
+        if (msg.finished && !msg.err_msg.has_value()) {
+          _known = true;
+          _online = true;
+          _info = msg.user_info;
+        }
+        broadcast(eventLine(msg));
+      }),
+      on<DrawLogout>([this](const DrawLogout& msg) {
+        if (msg.finished && !msg.err_msg.has_value()) {
+          _known = true;
+          _online = false;
+          _info = {};
+        }
+        broadcast(eventLine(msg));
+      }),
+      on<DrawAccount>([this](const DrawAccount& msg) {
+        auto prefix = "account " + msg.account + " ";
+        if (msg.removed) {
+          _accounts.erase(msg.account);
+          broadcast(prefix + "removed");
+          return;
+        }
+
+        if (std::holds_alternative<std::monostate>(msg.update)) {
+          _accounts[msg.account] = "added";
+          broadcast(prefix + "added");
+          return;
+        }
+
+        std::visit(
+            [&](const auto& update) {
+              if constexpr (!std::is_same_v<std::decay_t<decltype(update)>,
+                                            std::monostate>) {
+                if (auto state = accountState(update); !state.empty()) {
+                  _accounts[msg.account] = std::move(state);
+                }
+                if (auto line = eventLine(update); !line.empty()) {
+                  broadcast(prefix + line);
+                }
+              }
+            },
+            msg.update);
+      }),
+      on<ErrMsg>(
+          [this](const ErrMsg& msg) { broadcast("error " + msg.err_msg); }));
+
+  // Reports are few, so the socket thread takes all of them at once.
+  const DrainBudget all{.max_messages = SIZE_MAX};
+  std::vector<pollfd> fds;
+  for (;;) {
+    fds.clear();
+    fds.push_back({.fd = _wake->fd(), .events = POLLIN, .revents = 0});
+    fds.push_back({.fd = _listen_fd, .events = POLLIN, .revents = 0});
+    for (const auto& client : _clients) {
+      fds.push_back({.fd = client._fd, .events = POLLIN, .revents = 0});
+    }
+
+    // Sleeps until a client or the backend has something.
+    if (::poll(fds.data(), fds.size(), -1) < 0) {
+      continue;
+    }
+
+    if (_stop) {
+      return;
+    }
+
+    if ((fds[0].revents & POLLIN) != 0) {
+      _wake->clear();
+      events.poll(all);
+    }
+
+    // Clients dropped while broadcasting above keep their place until the
+    // sweep below, so `fds` still lines up with `_clients`. New clients are
+    // appended and wait for the next round.
+    for (std::size_t i = 2; i < fds.size(); ++i) {
+      auto& client = _clients[i - 2];
+      if (fds[i].revents == 0 || client._fd < 0) {
+        continue;
+      }
+
+      if (!readClient(client)) {
+        ::close(client._fd);
+        client._fd = -1;
+      }
+    }
+    std::erase_if(_clients,
+                  [](const Client& client) { return client._fd < 0; });
+
+    if ((fds[1].revents & POLLIN) != 0) {
+      acceptClients();
+    }
+  }
+}
+
+auto ControlSocket::acceptClients() -> void {
+  for (;;) {
+    auto fd = ::accept(_listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+      return;
+    }
+
+#if defined(SO_NOSIGPIPE)
+    int on = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+    if (!setNonBlocking(fd)) {
+      ::close(fd);
+      continue;
+    }
+    _clients.push_back(Client{._fd = fd, ._in = {}});
+  }
+}
+
+auto ControlSocket::readClient(Client& client) -> bool {
+  char buffer[512];
+  auto n = ::read(client._fd, buffer, sizeof(buffer));
+  if (n <= 0) {
+    return n < 0 && (errno == EAGAIN || errno == EINTR);
+  }
+
+  client._in.append(buffer, static_cast<std::size_t>(n));
+  std::size_t begin = 0;
+  for (auto end = client._in.find('\n'); end != std::string::npos;
+       end = client._in.find('\n', begin)) {
+    std::string_view line{client._in.data() + begin, end - begin};
+    if (!line.empty() && line.back() == '\r') {
+      line.remove_suffix(1);
+    }
+    if (!handle(client, line)) {
+      return false;
+    }
+    begin = end + 1;
+  }
+  client._in.erase(0, begin);
+  return client._in.size() <= MAX_LINE;
+}
+
+auto ControlSocket::handle(Client& client, std::string_view line) -> bool {
+  if (line.empty()) {
+    return true;
+  }
+
+  if (line == "login") {
+    _srun->send(RequestLogin{});
+  } else if (line == "info") {
+    _srun->send(RequestInfo{});
+  } else if (line == "logout") {
+    _srun->send(RequestLogout{});
+  } else if (line == "show" || line == "hide") {
+    if (!_window) {
+      return writeLine(client._fd, "err no window");
+    }
+    _window->send(RequestShowWindow{.show = line == "show"});
+  } else if (line == "state") {
+    return writeLine(client._fd, stateLine());
+  } else if (line == "ping") {
+    return writeLine(client._fd, "pong");
+  } else if (line == "accounts") {
+    return writeLine(client._fd, accountsLine());
+  } else if (line.starts_with("account ")) {
+    return handleAccount(client, line);
+  } else {
+    return writeLine(client._fd, "err unknown command");
+  }
+  return writeLine(client._fd, "ok " + std::string{line});
+}
+
+auto ControlSocket::handleAccount(Client& client, std::string_view line)
+    -> bool {
+  auto args = line;
+  nextWord(args);
+  auto command = nextWord(args);
+  std::string account{nextWord(args)};
+  if (account.empty()) {
+    return writeLine(client._fd, "err missing account");
+  }
+
+  if (command == "add") {
+    if (args.empty()) {
+      return writeLine(client._fd, "err missing config file");
+    }
+    // The rest of the line, so the file name may contain spaces.
+    _srun->send(RequestAddAccountFile{.account = std::move(account),
+                                      .config_file = std::string{args}});
+  } else if (command == "remove") {
+    _srun->send(RequestRemoveAccount{.account = std::move(account)});
+  } else if (command == "login") {
+    _srun->send(RequestAccountLogin{.account = std::move(account)});
+  } else if (command == "info") {
+    _srun->send(RequestAccountInfo{.account = std::move(account)});
+  } else if (command == "logout") {
+    _srun->send(RequestAccountLogout{.account = std::move(account)});
+  } else {
+    return writeLine(client._fd, "err unknown command");
+  }
+  return writeLine(client._fd, "ok " + std::string{line});
+}
+
+auto ControlSocket::broadcast(const std::string& line) -> void {
+  if (line.empty()) {
+    return;
+  }
+
+  // Failed clients are only marked; the loop sweeps them.
+  for (auto& client : _clients) {
+    if (0 <= client._fd && !writeLine(client._fd, line)) {
+      ::close(client._fd);
+      client._fd = -1;
+    }
+  }
+}
+
+auto ControlSocket::stateLine() const -> std::string {
+  if (!_known) {
+    return "state unknown";
+  }
+
+  if (!_online) {
+    return "state offline";
+  }
+
+  return "state online " +
+         (_info.username.empty() ? "username=" + _username
+                                 : infoFields(_info));
+}
+
+auto ControlSocket::accountsLine() const -> std::string {
+  std::string line = "accounts";
+  for (const auto& [account, state] : _accounts) {
+    line += " " + account + "=" + state;
+  }
+  return line;
+}
+
+#else
+
+ControlSocket::ControlSocket(std::string path) : _path{std::move(path)} {}
+
+ControlSocket::~ControlSocket() = default;
+
+auto ControlSocket::defaultPath() -> std::string { return {}; }
+
+// No Unix domain sockets here; the instance runs without one.
+auto ControlSocket::start(std::unique_ptr<Sender> /*srun*/,
+                          std::unique_ptr<Sender> /*window*/) -> Status {
+  return Status::Failed;
+}
+
+#endif
+
+}  // namespace srun_gui
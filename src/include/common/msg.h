@@ -3,8 +3,12 @@
 
 #include <optional>
 #include <string>
+#include <variant>
 #include <vector>
 
+#include "csp/cancel.h"
+#include "csp/message.h"
+
 namespace srun_gui {
 
 struct Config {
@@ -25,6 +29,8 @@ struct OnlineDeviceInfo {
   std::string ipv6;
   std::string os_name;
   std::string rad_online_id;
+
+  auto operator==(const OnlineDeviceInfo&) const -> bool = default;
 };
 
 struct UserInfo {
@@ -39,6 +45,8 @@ struct UserInfo {
   std::size_t remain_bytes{};
   std::size_t sum_bytes{};
   std::vector<OnlineDeviceInfo> online_device_info;
+
+  auto operator==(const UserInfo&) const -> bool = default;
 };
 
 struct RequestLoadConfigFile {
@@ -49,11 +57,63 @@ struct RequestLoadConfig {
   struct Config config;
 };
 
-struct RequestLogin {};
+// Network requests carry the token of the ui operation they belong to. A
+// cancelled request is dropped from the queue, or stops between steps.
+struct RequestLogin {
+  CancelToken cancel;
+};
+
+struct RequestInfo {
+  CancelToken cancel;
+};
+
+struct RequestLogout {
+  CancelToken cancel;
+};
+
+// SessionManager accounts, keyed by `account`.
+struct RequestAddAccount {
+  std::string account;
+  struct Config config;
+};
+
+// Adds an account from a config file, e.g. for the control socket.
+struct RequestAddAccountFile {
+  std::string account;
+  std::string config_file;
+};
+
+struct RequestRemoveAccount {
+  std::string account;
+};
+
+struct RequestAccountLogin {
+  std::string account;
+  CancelToken cancel;
+};
+
+struct RequestAccountInfo {
+  std::string account;
+  CancelToken cancel;
+};
+
+struct RequestAccountLogout {
+  std::string account;
+  CancelToken cancel;
+};
 
-struct RequestInfo {};
+// Polls info while the ui shows it, until `cancel` fires. Sent again when
+// the window is hidden or shown.
+struct RequestPollInfo {
+  bool hidden{false};
+  CancelToken cancel;
+};
 
-struct RequestLogout {};
+// Shows the window, or hides it so srun_gui runs in the background. Sent
+// straight to the ui, e.g. by the control socket.
+struct RequestShowWindow {
+  bool show{true};
+};
 
 struct ErrMsg {
   std::string err_msg;
@@ -66,16 +126,20 @@ struct DrawConfig {
   struct Config config;
 };
 
+// Replies carry the token of their request, so updates already queued for
+// the ui are dropped too once it cancels.
 struct DrawLogin {
   std::optional<std::string> err_msg;
   bool finished{};
   std::string username;
+  CancelToken cancel;
 };
 
 struct DrawInfo {
   std::optional<std::string> err_msg;
   bool finished{};
   UserInfo user_info;
+  CancelToken cancel;
 };
 
 struct DrawLogout {
@@ -83,8 +147,27 @@ struct DrawLogout {
   bool finished;
   std::string username;
   std::string ip;
+  CancelToken cancel;
 };
 
+// What the backend's own client would report, for one SessionManager
+// account. Without an update the account was just added, or removed.
+struct DrawAccount {
+  std::string account;
+  std::variant<std::monostate, DrawLogin, DrawInfo, DrawLogout> update;
+  bool removed{false};
+  CancelToken cancel;
+};
+
+// Errors overtake the ui's routine refresh traffic, e.g. a DrawInfo sent
+// before an ErrMsg is drawn after it; see Lane. Requests all keep the
+// Normal lane, so operations on an account run in the order they were sent.
+template <>
+inline constexpr Lane messageLane<ErrMsg> = Lane::Control;
+
+template <>
+inline constexpr Lane messageLane<DrawInfo> = Lane::Bulk;
+
 }  // namespace srun_gui
 
 #endif  // __SRUN_GUI_COMMON_MSG_H__
@@ -0,0 +1,116 @@
+#ifndef __SRUN_GUI_CONTROL_SOCKET_H__
+#define __SRUN_GUI_CONTROL_SOCKET_H__
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "common/msg.h"
+#include "csp/receiver.h"
+
+namespace srun_gui {
+
+// A Unix domain socket that lets local tools drive a running instance. The
+// protocol is one line per command, answered and followed by one line per
+// event:
+//
+//   login | info | logout   queued for the backend, answered with `ok`
+//   state                   the cached state, without asking the portal
+//   ping                    answered with `pong`
+//   show | hide             the window; a hidden srun_gui keeps running
+//   account add <name> <config file>
+//   account login | info | logout | remove <name>
+//                           the same for a SessionManager account
+//   accounts                `accounts <name>=<state>...`, the state being
+//                           added, online, offline or error
+//
+// Events are broadcast to every client as the backend reports them, e.g.
+// `login online <username>`, `info ok username=... in_bytes=...`, `logout ok`
+// or `error <message>`. Failures read `<event> error <message>`. Account
+// events read `account <name> ` followed by an event, `added` or `removed`.
+//
+// Only one instance can own a socket path; a second `start` returns
+// AlreadyRunning.
+class ControlSocket {
+ public:
+  enum class Status : std::uint8_t { Started, AlreadyRunning, Failed };
+
+  explicit ControlSocket(std::string path = defaultPath());
+
+  ControlSocket(const ControlSocket&) = delete;
+
+  ControlSocket(ControlSocket&&) noexcept = delete;
+
+  ControlSocket& operator=(const ControlSocket&) = delete;
+
+  ControlSocket& operator=(ControlSocket&&) noexcept = delete;
+
+  ~ControlSocket();
+
+  // $XDG_RUNTIME_DIR/srun_gui.sock, or one per user in /tmp.
+  static auto defaultPath() -> std::string;
+
+  // Where the backend reports to, see SrunBackend::addObserver.
+  auto getSender() const { return _events.getSender(); }
+
+  // Commands go to `srun`, show and hide to `window` if there is one.
+  auto start(std::unique_ptr<Sender> srun,
+             std::unique_ptr<Sender> window = nullptr) -> Status;
+
+  auto path() const -> const std::string& { return _path; }
+
+ private:
+  struct Client {
+    int _fd{-1};
+    std::string _in;
+  };
+
+  // Wakes the socket thread when the backend reports.
+  struct WakePipe;
+
+  auto loop() -> void;
+
+  auto acceptClients() -> void;
+
+  // Returns false once the client is gone or misbehaved.
+  auto readClient(Client& client) -> bool;
+
+  auto handle(Client& client, std::string_view line) -> bool;
+
+  auto handleAccount(Client& client, std::string_view line) -> bool;
+
+  auto broadcast(const std::string& line) -> void;
+
+  auto stateLine() const -> std::string;
+
+  auto accountsLine() const -> std::string;
+
+  std::string _path;
+  std::shared_ptr<WakePipe> _wake;
+  Receiver _events;
+  std::unique_ptr<Sender> _srun;
+  std::unique_ptr<Sender> _window;
+
+  int _lock_fd{-1};
+  int _listen_fd{-1};
+  std::vector<Client> _clients;
+
+  // What the events said last; only touched by the socket thread.
+  bool _known{false};
+  bool _online{false};
+  std::string _username;
+  UserInfo _info;
+  std::map<std::string, std::string> _accounts;
+
+  std::atomic<bool> _stop{false};
+  std::thread _thread;
+};
+
+}  // namespace srun_gui
+
+#endif  // __SRUN_GUI_CONTROL_SOCKET_H__
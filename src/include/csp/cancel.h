@@ -0,0 +1,46 @@
+#ifndef __SRUN_GUI_CSP_CANCEL_H__
+#define __SRUN_GUI_CSP_CANCEL_H__
+
+#include <atomic>
+#include <memory>
+
+namespace srun_gui {
+
+// Read side of a CancelSource. A default constructed token is never
+// cancelled, so messages can carry one unconditionally.
+class CancelToken {
+ public:
+  CancelToken() = default;
+
+  auto cancelled() const {
+    return _flag && _flag->load(std::memory_order_acquire);
+  }
+
+ private:
+  friend class CancelSource;
+
+  explicit CancelToken(std::shared_ptr<const std::atomic<bool>> flag)
+      : _flag{std::move(flag)} {}
+
+  std::shared_ptr<const std::atomic<bool>> _flag;
+};
+
+// Cancels every token it handed out. Start a new source for the next
+// operation; a cancelled source stays cancelled.
+class CancelSource {
+ public:
+  CancelSource() : _flag{std::make_shared<std::atomic<bool>>(false)} {}
+
+  auto token() const { return CancelToken{_flag}; }
+
+  auto cancel() { _flag->store(true, std::memory_order_release); }
+
+  auto cancelled() const { return _flag->load(std::memory_order_acquire); }
+
+ private:
+  std::shared_ptr<std::atomic<bool>> _flag;
+};
+
+}  // namespace srun_gui
+
+#endif  // __SRUN_GUI_CSP_CANCEL_H__
@@ -0,0 +1,69 @@
+#ifndef __SRUN_GUI_CSP_CONSUMER_PARKER_H__
+#define __SRUN_GUI_CSP_CONSUMER_PARKER_H__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+namespace srun_gui {
+
+namespace detail {
+
+// Parks the single consumer of a lock-free queue. Producers only touch the
+// mutex when the consumer has announced that it is about to sleep, so the
+// common push path is a couple of atomic operations.
+class ConsumerParker {
+ public:
+  template <typename Ready>
+  auto park(Ready&& ready) {
+    _parked.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (ready()) {
+      _parked.store(false, std::memory_order_relaxed);
+      return;
+    }
+
+    std::unique_lock lock{_m};
+    _cond.wait(lock, ready);
+    _parked.store(false, std::memory_order_relaxed);
+  }
+
+  // Returns false if the deadline passed before `ready` held.
+  template <typename Clock, typename Duration, typename Ready>
+  auto parkUntil(const std::chrono::time_point<Clock, Duration>& deadline,
+                 Ready&& ready) -> bool {
+    _parked.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (ready()) {
+      _parked.store(false, std::memory_order_relaxed);
+      return true;
+    }
+
+    std::unique_lock lock{_m};
+    auto res = _cond.wait_until(lock, deadline, ready);
+    _parked.store(false, std::memory_order_relaxed);
+    return res;
+  }
+
+  auto unpark() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!_parked.load(std::memory_order_relaxed)) {
+      return;
+    }
+
+    std::scoped_lock lock{_m};
+    _cond.notify_one();
+  }
+
+ private:
+  std::atomic<bool> _parked{false};
+  std::mutex _m{};
+  std::condition_variable _cond{};
+};
+
+}  // namespace detail
+
+}  // namespace srun_gui
+
+#endif  // __SRUN_GUI_CSP_CONSUMER_PARKER_H__
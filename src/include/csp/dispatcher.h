@@ -1,16 +1,37 @@
 #ifndef __SRUN_GUI_CSP_DISPATCHER_H__
 #define __SRUN_GUI_CSP_DISPATCHER_H__
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <exception>
 #include <memory>
+#include <tuple>
+#include <type_traits>
 #include <utility>
+#include <vector>
 
 #include "csp/message.h"
 
 namespace srun_gui {
 
+// Closes the queue it is received from.
 struct CloseQueueMsg {};
 
+template <>
+inline constexpr Lane messageLane<CloseQueueMsg> = Lane::Control;
+
+enum class DispatchResult : std::uint8_t {
+  // Nothing was handled: the queue was empty, the deadline passed or no
+  // handler matched.
+  Unhandled,
+  Handled,
+  // The queue is closed and drained; no more messages will arrive.
+  Closed,
+};
+
 class DispatcherException : public std::exception {};
 
 class DispatcherExceptionGetCloseQueueMsg : public DispatcherException {
@@ -20,9 +41,153 @@ class DispatcherExceptionGetCloseQueueMsg : public DispatcherException {
   }
 };
 
+#if defined(__cpp_exceptions)
+// Opt-in for callers that prefer to leave their loop by exception.
+inline auto throwIfClosed(DispatchResult result) -> DispatchResult {
+  if (result == DispatchResult::Closed) {
+    throw DispatcherExceptionGetCloseQueueMsg{};
+  }
+  return result;
+}
+#endif
+
+// Limits how much a non-blocking dispatcher handles in one call. The default
+// handles a single message, as before.
+struct DrainBudget {
+  std::size_t max_messages{1};
+  std::chrono::steady_clock::duration max_time{
+      std::chrono::steady_clock::duration::max()};
+  // Checked before every message; a handler sets it to leave the drain
+  // early, e.g. after switching state.
+  const bool *stop{nullptr};
+};
+
+namespace detail {
+
+// One handler of a dispatch chain, erased to a plain function pointer.
+struct DispatchSlot {
+  void *_node;
+  void (*_handle)(void *node, Message &msg);
+};
+
+// Maps message type ids to the slot of their handler. Built once per chain
+// type, so a lookup is a single indexed load whatever the chain length.
+class DispatchIndex {
+ public:
+  static constexpr std::uint8_t NO_HANDLER = 0xFF;
+
+  template <std::size_t N>
+  explicit DispatchIndex(const std::array<MessageTypeId, N> &type_ids) {
+    static_assert(N < NO_HANDLER, "Too many handlers in one dispatcher");
+    _slot.assign(*std::ranges::max_element(type_ids) + 1, NO_HANDLER);
+    // Later handlers for the same type win, as with the old cast chain.
+    for (std::size_t i = 0; i < N; ++i) {
+      _slot[type_ids[i]] = static_cast<std::uint8_t>(i);
+    }
+  }
+
+  auto find(MessageTypeId type_id) const -> std::size_t {
+    if (_slot.size() <= type_id) {
+      return NO_HANDLER;
+    }
+    return _slot[type_id];
+  }
+
+ private:
+  std::vector<std::uint8_t> _slot;
+};
+
+// Slot 0 always belongs to the head, which handles CloseQueueMsg.
+inline auto dispatchMessage(const DispatchIndex &index,
+                            const DispatchSlot *slots, Message &msg)
+    -> DispatchResult {
+  auto i = index.find(msg.typeId());
+  if (i == DispatchIndex::NO_HANDLER) {
+    return DispatchResult::Unhandled;
+  }
+
+  slots[i]._handle(slots[i]._node, msg);
+  return i == 0 ? DispatchResult::Closed : DispatchResult::Handled;
+}
+
+// Handles queued messages until the queue is empty or the budget is spent.
+// At least one message is handled if there is one. Stashed messages that
+// `match` accepts go first, and unhandled ones are stashed.
+template <typename Match, typename Handle>
+auto drainQueue(MessageQueue &q, const DrainBudget &budget, Match &&match,
+                Handle &&handle) -> DispatchResult {
+  const bool timed =
+      budget.max_time != std::chrono::steady_clock::duration::max();
+  const auto start =
+      timed ? std::chrono::steady_clock::now()
+            : std::chrono::steady_clock::time_point{};
+  auto result = DispatchResult::Unhandled;
+  MessagePtr msg;
+  for (std::size_t handled = 0; handled < budget.max_messages; ++handled) {
+    if (budget.stop != nullptr && *budget.stop) {
+      return result;
+    }
+
+    if (timed && handled != 0 &&
+        budget.max_time <= std::chrono::steady_clock::now() - start) {
+      return result;
+    }
+
+    if (!q.unstash(msg, match) && !q.tryPop(msg)) {
+      break;
+    }
+
+    auto res = handle(*msg);
+    if (res == DispatchResult::Closed) {
+      return res;
+    }
+    if (res == DispatchResult::Handled) {
+      result = res;
+    } else {
+      q.stash(std::move(msg));
+    }
+  }
+
+  if (result == DispatchResult::Unhandled && q.closed() && q.empty()) {
+    return DispatchResult::Closed;
+  }
+  return result;
+}
+
+// Blocks until a message is handled, the queue is closed and drained or
+// `deadline` has passed. Stashed messages that `match` accepts go first, and
+// unhandled ones are stashed.
+template <typename Match, typename Handle>
+auto waitQueue(MessageQueue &q, std::chrono::steady_clock::time_point deadline,
+               Match &&match, Handle &&handle) -> DispatchResult {
+  auto next = [&](MessagePtr &msg) {
+    if (q.unstash(msg, match)) {
+      return true;
+    }
+    if (deadline == std::chrono::steady_clock::time_point::max()) {
+      return q.waitAndPop(msg);
+    }
+    return q.waitUntil(msg, deadline);
+  };
+
+  MessagePtr msg;
+  while (next(msg)) {
+    auto res = handle(*msg);
+    if (res != DispatchResult::Unhandled) {
+      return res;
+    }
+    q.stash(std::move(msg));
+  }
+  return q.closed() ? DispatchResult::Closed : DispatchResult::Unhandled;
+}
+
+}  // namespace detail
+
 template <typename Msg, typename PrevNode, typename Func, bool Blocking>
 class DispatcherNode;
 
+// A dispatch chain runs when its last node is destroyed, or earlier through
+// `run()`, which also reports what happened.
 template <bool Blocking>
 class DispatcherHead {
   template <typename Msg, typename PrevNodePtr, typename Func,
@@ -30,7 +195,16 @@ class DispatcherHead {
   friend class DispatcherNode;
 
  public:
-  explicit DispatcherHead(std::shared_ptr<MessageQueue> q) : _q{std::move(q)} {}
+  explicit DispatcherHead(std::shared_ptr<MessageQueue> q,
+                          DrainBudget budget = {})
+      : _q{std::move(q)}, _budget{budget} {}
+
+  // Blocking dispatcher that gives up once `deadline` has passed.
+  DispatcherHead(std::shared_ptr<MessageQueue> q,
+                 std::chrono::steady_clock::time_point deadline)
+      : _q{std::move(q)}, _deadline{deadline} {
+    static_assert(Blocking, "Only a blocking dispatcher waits for a deadline");
+  }
 
   DispatcherHead(const DispatcherHead &) = delete;
 
@@ -40,9 +214,10 @@ class DispatcherHead {
 
   DispatcherHead &operator=(DispatcherHead &&) noexcept = default;
 
+  // Only handler exceptions can escape.
   ~DispatcherHead() noexcept(false) {
     if (_tail) {
-      run();
+      execute();
     }
   }
 
@@ -50,39 +225,58 @@ class DispatcherHead {
   DispatcherNode<OtherMsg, DispatcherHead, OtherFunc, Blocking> dispatch(
       OtherFunc &&func) {
     return DispatcherNode<OtherMsg, DispatcherHead, OtherFunc, Blocking>{
-        this, std::forward<OtherFunc>(func), _q};
+        this, std::forward<OtherFunc>(func), this};
+  }
+
+  auto run() -> DispatchResult {
+    _tail = false;
+    return execute();
   }
 
  private:
+  static constexpr std::size_t SLOT_COUNT = 1;
+
   bool _tail{true};
   std::shared_ptr<MessageQueue> _q;
+  DrainBudget _budget;
+  std::chrono::steady_clock::time_point _deadline{
+      std::chrono::steady_clock::time_point::max()};
 
   void join() { _tail = false; }
 
-  void run() {
-    std::shared_ptr<Message> msg;
+  auto execute() -> DispatchResult {
+    auto handle = [this](Message &msg) { return tryHandleMsg(msg); };
     if constexpr (Blocking) {
-      for (;;) {
-        _q->waitAndPop(msg);
-        tryHandleMsg(msg);
-      }
+      return detail::waitQueue(*_q, _deadline, isCloseQueueMsg, handle);
     } else {
-      if (!_q->tryPop(msg)) {
-        return;
-      }
-
-      tryHandleMsg(msg);
+      return detail::drainQueue(*_q, _budget, isCloseQueueMsg, handle);
     }
   }
 
-  bool tryHandleMsg(const std::shared_ptr<Message> &msg) {
-    auto close_msg =
-        std::dynamic_pointer_cast<MessageWrapper<CloseQueueMsg>>(msg);
-    if (close_msg == nullptr) {
-      return false;
+  template <std::size_t N>
+  static void collectTypes(std::array<MessageTypeId, N> &type_ids) {
+    type_ids[0] = messageTypeId<CloseQueueMsg>();
+  }
+
+  void collectSlots(detail::DispatchSlot *slots) {
+    slots[0] = {this, &DispatcherHead::handleCloseQueueMsg};
+  }
+
+  static auto isCloseQueueMsg(MessageTypeId type_id) -> bool {
+    return type_id == messageTypeId<CloseQueueMsg>();
+  }
+
+  static void handleCloseQueueMsg(void *node, Message & /*msg*/) {
+    static_cast<DispatcherHead *>(node)->_q->close();
+  }
+
+  auto tryHandleMsg(Message &msg) -> DispatchResult {
+    if (msg.typeId() != messageTypeId<CloseQueueMsg>()) {
+      return DispatchResult::Unhandled;
     }
 
-    throw DispatcherExceptionGetCloseQueueMsg{};
+    handleCloseQueueMsg(this, msg);
+    return DispatchResult::Closed;
   }
 };
 
@@ -92,11 +286,15 @@ class DispatcherNode {
             bool OtherBlocking>
   friend class DispatcherNode;
 
+  // The head's close handler would silently lose to a later handler.
+  static_assert(!std::is_same_v<Msg, CloseQueueMsg>,
+                "CloseQueueMsg is handled by the dispatcher itself");
+
  public:
   using NodePtr = PrevNode *;
 
-  DispatcherNode(NodePtr prev, Func func, std::shared_ptr<MessageQueue> q)
-      : _prev{prev}, _func{std::move(func)}, _q{std::move(q)} {
+  DispatcherNode(NodePtr prev, Func func, DispatcherHead<Blocking> *head)
+      : _prev{prev}, _func{std::move(func)}, _head{head} {
     prev->join();
   }
 
@@ -108,9 +306,9 @@ class DispatcherNode {
 
   DispatcherNode &operator=(DispatcherNode &&) noexcept = delete;
 
-  ~DispatcherNode() {
+  ~DispatcherNode() noexcept(false) {
     if (_tail) {
-      run();
+      execute();
     }
   }
 
@@ -118,44 +316,222 @@ class DispatcherNode {
   DispatcherNode<OtherMsg, DispatcherNode, OtherFunc, Blocking> dispatch(
       OtherFunc &&func) {
     return DispatcherNode<OtherMsg, DispatcherNode, OtherFunc, Blocking>{
-        this, std::forward<OtherFunc>(func), _q};
+        this, std::forward<OtherFunc>(func), _head};
+  }
+
+  auto run() -> DispatchResult {
+    _tail = false;
+    return execute();
   }
 
  private:
+  static constexpr std::size_t SLOT_COUNT = PrevNode::SLOT_COUNT + 1;
+
   bool _tail{true};
   NodePtr _prev;
   Func _func;
-  std::shared_ptr<MessageQueue> _q;
+  DispatcherHead<Blocking> *_head;
 
   void join() { _tail = false; }
 
-  void run() {
-    std::shared_ptr<Message> msg;
+  auto execute() -> DispatchResult {
+    static const detail::DispatchIndex index{[] {
+      std::array<MessageTypeId, SLOT_COUNT> type_ids{};
+      collectTypes(type_ids);
+      return type_ids;
+    }()};
+
+    std::array<detail::DispatchSlot, SLOT_COUNT> slots{};
+    collectSlots(slots.data());
+
+    auto match = [](MessageTypeId type_id) {
+      return index.find(type_id) != detail::DispatchIndex::NO_HANDLER;
+    };
+    auto handle = [&slots](Message &msg) {
+      return detail::dispatchMessage(index, slots.data(), msg);
+    };
     if constexpr (Blocking) {
-      for (;;) {
-        _q->waitAndPop(msg);
-        if (tryHandleMsg(msg)) {
-          break;
-        }
-      }
+      return detail::waitQueue(*_head->_q, _head->_deadline, match, handle);
     } else {
-      if (!_q->tryPop(msg)) {
-        return;
-      }
-
-      tryHandleMsg(msg);
+      return detail::drainQueue(*_head->_q, _head->_budget, match, handle);
     }
   }
 
-  bool tryHandleMsg(const std::shared_ptr<Message> &msg) {
-    auto my_msg_wrapper = std::dynamic_pointer_cast<MessageWrapper<Msg>>(msg);
-    if (my_msg_wrapper != nullptr) {
-      _func(my_msg_wrapper->content());
-      return true;
+  template <std::size_t N>
+  static void collectTypes(std::array<MessageTypeId, N> &type_ids) {
+    PrevNode::collectTypes(type_ids);
+    type_ids[SLOT_COUNT - 1] = messageTypeId<Msg>();
+  }
+
+  void collectSlots(detail::DispatchSlot *slots) {
+    _prev->collectSlots(slots);
+    slots[SLOT_COUNT - 1] = {this, &DispatcherNode::handle};
+  }
+
+  static void handle(void *node, Message &msg) {
+    // The index only routes messages tagged with Msg here.
+    static_cast<DispatcherNode *>(node)->_func(
+        static_cast<MessageWrapper<Msg> &>(msg).content());
+  }
+};
+
+// A handler for Msg, see `on`.
+template <typename Msg, typename Func>
+struct Handler {
+  using MessageType = Msg;
+
+  Func _func;
+};
+
+template <typename Msg, typename Func>
+auto on(Func &&func) {
+  return Handler<Msg, std::decay_t<Func>>{std::forward<Func>(func)};
+}
+
+// A dispatch table that is built once and pumped repeatedly, e.g. once per
+// frame. Unlike a `wait()` chain, nothing is rebuilt per call: the handlers
+// are stored by value and messages reach them through a static jump table.
+//
+//   auto dispatcher = receiver.dispatcher(
+//       on<A>([](const A &a) { ... }),
+//       on<B>([](const B &b) { ... }));
+//   dispatcher.poll(budget);
+template <typename... Handlers>
+class Dispatcher {
+  // The built-in close handler in slot 0 would silently lose to it.
+  static_assert(
+      (!std::is_same_v<typename Handlers::MessageType, CloseQueueMsg> && ...),
+      "CloseQueueMsg is handled by the dispatcher itself");
+
+ public:
+  explicit Dispatcher(std::shared_ptr<MessageQueue> q, Handlers... handlers)
+      : _q{std::move(q)}, _handlers{std::move(handlers)...} {}
+
+  // Handles queued messages within `budget` without blocking.
+  auto poll(const DrainBudget &budget = {}) -> DispatchResult {
+    return detail::drainQueue(*_q, budget, match,
+                              [this](Message &msg) { return handle(msg); });
+  }
+
+  // Blocks until a message is handled or the queue is closed.
+  auto wait() -> DispatchResult {
+    return waitUntil(std::chrono::steady_clock::time_point::max());
+  }
+
+  auto waitUntil(std::chrono::steady_clock::time_point deadline)
+      -> DispatchResult {
+    return detail::waitQueue(*_q, deadline, match,
+                             [this](Message &msg) { return handle(msg); });
+  }
+
+ private:
+  using Slot = void (*)(Dispatcher &, Message &);
+
+  static constexpr std::size_t SLOT_COUNT = sizeof...(Handlers) + 1;
+
+  // Slot 0 handles CloseQueueMsg, as in a `wait()` chain.
+  template <std::size_t... I>
+  static constexpr auto makeSlots(std::index_sequence<I...> /*unused*/) {
+    return std::array<Slot, SLOT_COUNT>{&closeQueue, &call<I>...};
+  }
+
+  static constexpr std::array<Slot, SLOT_COUNT> SLOTS =
+      makeSlots(std::index_sequence_for<Handlers...>{});
+
+  static auto index() -> const detail::DispatchIndex & {
+    static const detail::DispatchIndex index{
+        std::array<MessageTypeId, SLOT_COUNT>{
+            messageTypeId<CloseQueueMsg>(),
+            messageTypeId<typename Handlers::MessageType>()...}};
+    return index;
+  }
+
+  static auto match(MessageTypeId type_id) -> bool {
+    return index().find(type_id) != detail::DispatchIndex::NO_HANDLER;
+  }
+
+  static void closeQueue(Dispatcher &self, Message & /*msg*/) {
+    self._q->close();
+  }
+
+  template <std::size_t I>
+  static void call(Dispatcher &self, Message &msg) {
+    using Entry = std::tuple_element_t<I, std::tuple<Handlers...>>;
+    using Msg = typename Entry::MessageType;
+    auto &handler = std::get<I>(self._handlers);
+    // The index only routes messages tagged with Msg here.
+    handler._func(static_cast<MessageWrapper<Msg> &>(msg).content());
+  }
+
+  auto handle(Message &msg) -> DispatchResult {
+    auto i = index().find(msg.typeId());
+    if (i == detail::DispatchIndex::NO_HANDLER) {
+      return DispatchResult::Unhandled;
     }
 
-    return _prev->tryHandleMsg(msg);
+    SLOTS[i](*this, msg);
+    return i == 0 ? DispatchResult::Closed : DispatchResult::Handled;
   }
+
+  std::shared_ptr<MessageQueue> _q;
+  std::tuple<Handlers...> _handlers;
+};
+
+// A Dispatcher whose handler types are erased, so it can be a class member
+// that the constructor builds. Each poll or wait costs one virtual call on
+// top of the Dispatcher's own.
+class AnyDispatcher {
+ public:
+  AnyDispatcher() = default;
+
+  // Implicit, so `receiver.dispatcher(...)` can be assigned directly.
+  template <typename... Handlers>
+  AnyDispatcher(Dispatcher<Handlers...> dispatcher)
+      : _dispatcher{std::make_unique<Model<Dispatcher<Handlers...>>>(
+            std::move(dispatcher))} {}
+
+  // An empty AnyDispatcher handles nothing.
+  auto poll(const DrainBudget &budget = {}) -> DispatchResult {
+    return _dispatcher ? _dispatcher->poll(budget) : DispatchResult::Unhandled;
+  }
+
+  auto wait() -> DispatchResult {
+    return waitUntil(std::chrono::steady_clock::time_point::max());
+  }
+
+  auto waitUntil(std::chrono::steady_clock::time_point deadline)
+      -> DispatchResult {
+    return _dispatcher ? _dispatcher->waitUntil(deadline)
+                       : DispatchResult::Unhandled;
+  }
+
+ private:
+  struct Concept {
+    virtual ~Concept() = default;
+
+    virtual auto poll(const DrainBudget &budget) -> DispatchResult = 0;
+
+    virtual auto waitUntil(std::chrono::steady_clock::time_point deadline)
+        -> DispatchResult = 0;
+  };
+
+  template <typename D>
+  struct Model final : Concept {
+    explicit Model(D dispatcher) : _dispatcher{std::move(dispatcher)} {}
+
+    auto poll(const DrainBudget &budget) -> DispatchResult override {
+      return _dispatcher.poll(budget);
+    }
+
+    auto waitUntil(std::chrono::steady_clock::time_point deadline)
+        -> DispatchResult override {
+      return _dispatcher.waitUntil(deadline);
+    }
+
+    D _dispatcher;
+  };
+
+  std::unique_ptr<Concept> _dispatcher;
 };
 
 }  // namespace srun_gui
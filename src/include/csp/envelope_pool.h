@@ -0,0 +1,91 @@
+#ifndef __SRUN_GUI_CSP_ENVELOPE_POOL_H__
+#define __SRUN_GUI_CSP_ENVELOPE_POOL_H__
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+
+namespace srun_gui {
+
+// Fixed-size blocks that hold messages while they travel through a queue.
+//
+// A pool belongs to one Sender and is only acquired from on that sender's
+// thread. Receivers hand consumed blocks back with `recycle`, from any
+// thread. The owner takes the whole returned list with one exchange, so
+// blocks are never popped one by one concurrently and there is no ABA.
+class EnvelopePool {
+ public:
+  static constexpr std::size_t ENVELOPE_SIZE = 320;
+
+  EnvelopePool() = default;
+
+  EnvelopePool(const EnvelopePool&) = delete;
+
+  EnvelopePool(EnvelopePool&&) noexcept = delete;
+
+  EnvelopePool& operator=(const EnvelopePool&) = delete;
+
+  EnvelopePool& operator=(EnvelopePool&&) noexcept = delete;
+
+  ~EnvelopePool() {
+    freeList(_local);
+    freeList(_returned.exchange(nullptr, std::memory_order_acquire));
+  }
+
+  static constexpr auto fits(std::size_t size, std::size_t align) {
+    return size <= ENVELOPE_SIZE && align <= alignof(std::max_align_t);
+  }
+
+  // Owner thread only. Returns storage for one envelope.
+  auto acquire() -> void* {
+    if (_local == nullptr) {
+      _local = _returned.exchange(nullptr, std::memory_order_acquire);
+    }
+
+    if (_local != nullptr) {
+      auto* block = _local;
+      _local = block->_next;
+      return block;
+    }
+
+    _heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    return ::operator new(ENVELOPE_SIZE);
+  }
+
+  // Any thread. `block` must come from `acquire` of this pool.
+  auto recycle(void* block) noexcept {
+    auto* free_block = ::new (block) FreeBlock{};
+    free_block->_next = _returned.load(std::memory_order_relaxed);
+    while (!_returned.compare_exchange_weak(free_block->_next, free_block,
+                                            std::memory_order_release,
+                                            std::memory_order_relaxed)) {
+    }
+  }
+
+  // Number of blocks this pool ever took from the heap. Stays flat once
+  // the traffic pattern has warmed up.
+  auto heapAllocations() const {
+    return _heap_allocations.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct FreeBlock {
+    FreeBlock* _next{nullptr};
+  };
+
+  static auto freeList(FreeBlock* block) -> void {
+    while (block != nullptr) {
+      auto* next = block->_next;
+      ::operator delete(block);
+      block = next;
+    }
+  }
+
+  FreeBlock* _local{nullptr};
+  std::atomic<std::size_t> _heap_allocations{0};
+  alignas(64) std::atomic<FreeBlock*> _returned{nullptr};
+};
+
+}  // namespace srun_gui
+
+#endif  // __SRUN_GUI_CSP_ENVELOPE_POOL_H__
@@ -1,42 +1,156 @@
 #ifndef __SRUN_GUI_CSP_MESSAGE_H__
 #define __SRUN_GUI_CSP_MESSAGE_H__
 
-#include "csp/thread_safe_queue.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+#include "csp/consumer_parker.h"
+#include "csp/envelope_pool.h"
+#include "csp/sample_ring.h"
 
 namespace srun_gui {
 
+using MessageTypeId = std::size_t;
+
+namespace detail {
+
+inline auto nextMessageTypeId() -> MessageTypeId {
+  static std::atomic<MessageTypeId> next{0};
+  return next.fetch_add(1, std::memory_order_relaxed);
+}
+
+}  // namespace detail
+
+// Dense per-type tag. Ids are handed out on first use and never change, so
+// dispatchers can index tables with them instead of casting.
+template <typename Msg>
+auto messageTypeId() -> MessageTypeId {
+  static const MessageTypeId id = detail::nextMessageTypeId();
+  return id;
+}
+
+class MessageQueue;
+
+class Sender;
+
+namespace detail {
+class MessageLane;
+}  // namespace detail
+
+// Priority lanes of a MessageQueue. Higher lanes are always popped first.
+//
+// Order only holds within a lane: what one Sender puts into a lane arrives
+// in the order it was sent, but a message in a higher lane overtakes
+// everything queued below it, however long ago and by whoever it was sent.
+// A Normal RequestLogout sent after a Bulk RequestInfo is handled first,
+// and a DrawLogout can reach the ui ahead of an older DrawInfo. Messages
+// that must stay in order belong in one lane. A coalesced message takes the
+// lane and place of its queued predecessor.
+enum class Lane : std::uint8_t { Bulk, Normal, Control };
+
+inline constexpr std::size_t LANE_COUNT = 3;
+
+// Lane a message type is sent on unless the sender says otherwise.
+template <typename Msg>
+inline constexpr Lane messageLane = Lane::Normal;
+
+// A message envelope. It is also the node of the intrusive MessageQueue, so
+// queuing a message never allocates on its own.
 struct Message {
 public:
-  Message() = default;
+  static constexpr MessageTypeId INVALID_TYPE_ID =
+      std::numeric_limits<MessageTypeId>::max();
 
-  Message(const Message &) = default;
+  explicit Message(MessageTypeId type_id) : _type_id{type_id} {}
 
-  Message(Message &&) noexcept = default;
+  Message(const Message &) = delete;
 
-  Message &operator=(const Message &) = default;
+  Message(Message &&) noexcept = delete;
 
-  Message &operator=(Message &&) noexcept = default;
+  Message &operator=(const Message &) = delete;
+
+  Message &operator=(Message &&) noexcept = delete;
 
   virtual ~Message() noexcept = default;
+
+  auto typeId() const { return _type_id; }
+
+  // Destroys the message and gives its storage back to where it came from.
+  virtual void release() noexcept { delete this; }
+
+  // A cancelled message is dropped by its queue instead of being delivered.
+  virtual auto cancelled() const -> bool { return false; }
+
+protected:
+  auto pool() const { return _pool; }
+
+private:
+  friend class MessageQueue;
+  friend class Sender;
+  friend class detail::MessageLane;
+
+  MessageTypeId _type_id;
+  std::atomic<Message *> _next{nullptr};
+  EnvelopePool *_pool{nullptr};
+  // Only stamped by queues that record latency.
+  std::chrono::steady_clock::time_point _sent;
 };
 
+struct MessageDeleter {
+  void operator()(Message *msg) const noexcept { msg->release(); }
+};
+
+using MessagePtr = std::unique_ptr<Message, MessageDeleter>;
+
 template <typename Msg> struct MessageWrapper : Message {
 
-  MessageWrapper() = default;
+  static_assert(std::is_same_v<Msg, std::remove_cvref_t<Msg>>,
+                "MessageWrapper must wrap a plain value type");
 
-  explicit MessageWrapper(const Msg &msg) : _msg(msg) {}
+  MessageWrapper() : Message{messageTypeId<Msg>()} {}
 
-  explicit MessageWrapper(Msg &&msg) : _msg(std::move(msg)) {}
+  explicit MessageWrapper(const Msg &msg)
+      : Message{messageTypeId<Msg>()}, _msg(msg) {}
 
-  MessageWrapper(const MessageWrapper &) = default;
+  explicit MessageWrapper(Msg &&msg)
+      : Message{messageTypeId<Msg>()}, _msg(std::move(msg)) {}
 
-  MessageWrapper(MessageWrapper &&) noexcept = default;
+  ~MessageWrapper() noexcept override = default;
 
-  MessageWrapper &operator=(const MessageWrapper &) = default;
+  void release() noexcept override {
+    auto *envelope_pool = pool();
+    if (envelope_pool == nullptr) {
+      delete this;
+      return;
+    }
 
-  MessageWrapper &operator=(MessageWrapper &&) noexcept = default;
+    this->~MessageWrapper();
+    envelope_pool->recycle(this);
+  }
 
-  ~MessageWrapper() noexcept override = default;
+  // Msg is cancellable through a `cancelled()` member or a CancelToken
+  // member named `cancel`.
+  auto cancelled() const -> bool override {
+    if constexpr (requires { _msg.cancelled(); }) {
+      return _msg.cancelled();
+    } else if constexpr (requires { _msg.cancel.cancelled(); }) {
+      return _msg.cancel.cancelled();
+    } else {
+      return false;
+    }
+  }
 
   const Msg &content() const { return _msg; }
 
@@ -45,7 +159,608 @@ template <typename Msg> struct MessageWrapper : Message {
   Msg _msg;
 };
 
-using MessageQueue = ThreadSafeQueue<std::shared_ptr<Message>>;
+namespace detail {
+
+// One FIFO of a MessageQueue: Vyukov's intrusive multi-producer/single-
+// consumer algorithm with a stub node.
+class MessageLane {
+public:
+  MessageLane() = default;
+
+  MessageLane(const MessageLane &) = delete;
+
+  MessageLane(MessageLane &&) noexcept = delete;
+
+  MessageLane &operator=(const MessageLane &) = delete;
+
+  MessageLane &operator=(MessageLane &&) noexcept = delete;
+
+  ~MessageLane() = default;
+
+  // Consumer only.
+  auto empty() const {
+    return _tail == &_stub &&
+           _stub._next.load(std::memory_order_acquire) == nullptr;
+  }
+
+  // Consumer only. The message `pop` returns next, if any.
+  auto front() const -> Message * {
+    if (_tail != &_stub) {
+      return _tail;
+    }
+    return _stub._next.load(std::memory_order_acquire);
+  }
+
+  auto push(Message *node) -> void {
+    node->_next.store(nullptr, std::memory_order_relaxed);
+    auto *prev = _head.exchange(node, std::memory_order_acq_rel);
+    prev->_next.store(node, std::memory_order_release);
+  }
+
+  // Consumer only.
+  auto pop() -> Message * {
+    auto *tail = _tail;
+    auto *next = tail->_next.load(std::memory_order_acquire);
+    if (tail == &_stub) {
+      if (next == nullptr) {
+        return nullptr;
+      }
+      _tail = next;
+      tail = next;
+      next = next->_next.load(std::memory_order_acquire);
+    }
+
+    if (next != nullptr) {
+      _tail = next;
+      return tail;
+    }
+
+    if (tail != _head.load(std::memory_order_acquire)) {
+      // A producer is between its exchange and its link.
+      return nullptr;
+    }
+
+    push(&_stub);
+    next = tail->_next.load(std::memory_order_acquire);
+    if (next != nullptr) {
+      _tail = next;
+      return tail;
+    }
+
+    return nullptr;
+  }
+
+private:
+  Message _stub{Message::INVALID_TYPE_ID};
+  alignas(64) std::atomic<Message *> _head{&_stub};
+  alignas(64) Message *_tail{&_stub};
+};
+
+}  // namespace detail
+
+enum class OverflowPolicy : std::uint8_t {
+  // The sender waits until the consumer makes room.
+  Block,
+  // The oldest queued message is discarded to make room.
+  DropOldest,
+  // The new message is discarded and `push` returns false.
+  Reject,
+};
+
+struct QueueOptions {
+  std::size_t capacity{std::numeric_limits<std::size_t>::max()};
+  OverflowPolicy overflow{OverflowPolicy::Block};
+};
+
+// Selective receive: messages the running dispatcher has no handler for are
+// kept and replayed to a later dispatcher that has one. A capacity of zero
+// turns it off, so unhandled messages are dropped.
+struct StashOptions {
+  std::size_t capacity{0};
+  // Stashed messages older than this are dropped instead of replayed.
+  std::chrono::steady_clock::duration max_age{
+      std::chrono::steady_clock::duration::max()};
+};
+
+// Intrusive multi-producer/single-consumer queue of messages with one FIFO
+// per Lane. It also owns the envelope pools of the senders that feed it, so
+// pooled storage outlives every message in flight.
+//
+// Message types registered with `coalesce` keep only their newest instance:
+// it takes the place of the queued older one instead of being appended.
+//
+// A closed queue refuses new messages; what is already queued can still be
+// popped, after which waits return false instead of blocking.
+//
+// The stash is only touched by the consumer, like the dispatchers that use
+// it.
+class MessageQueue {
+public:
+  MessageQueue() : MessageQueue{QueueOptions{}} {}
+
+  explicit MessageQueue(QueueOptions options)
+      : MessageQueue{options, std::make_shared<detail::ConsumerParker>()} {}
+
+  // Queues that share a parker wake the same consumer, see Select.
+  MessageQueue(QueueOptions options,
+               std::shared_ptr<detail::ConsumerParker> parker)
+      : _options{options}, _parker{std::move(parker)} {}
+
+  MessageQueue(const MessageQueue &) = delete;
+
+  MessageQueue(MessageQueue &&) noexcept = delete;
+
+  MessageQueue &operator=(const MessageQueue &) = delete;
+
+  MessageQueue &operator=(MessageQueue &&) noexcept = delete;
+
+  ~MessageQueue() {
+    // Stashed messages may live in pools destroyed before the stash.
+    _stash.clear();
+    MessagePtr msg;
+    while (tryPop(msg)) {
+      msg.reset();
+    }
+  }
+
+  // Must be called before any message is pushed.
+  template <typename Msg> auto coalesce() {
+    auto type_id = messageTypeId<Msg>();
+    if (_coalesce.size() <= type_id) {
+      _coalesce.resize(type_id + 1);
+    }
+    if (!_coalesce[type_id]) {
+      _coalesce[type_id] = std::make_unique<CoalesceSlot>(type_id);
+    }
+  }
+
+  // Consumer only. The oldest message is dropped when the stash is full.
+  auto selective(StashOptions options) { _stash_options = options; }
+
+  // Consumer only. Overrides StashOptions::max_age for Msg.
+  template <typename Msg>
+  auto stashMaxAge(std::chrono::steady_clock::duration max_age) {
+    auto type_id = messageTypeId<Msg>();
+    if (_stash_max_age.size() <= type_id) {
+      _stash_max_age.resize(type_id + 1, NO_MAX_AGE);
+    }
+    _stash_max_age[type_id] = max_age;
+  }
+
+  auto stashed() const { return _stash.size(); }
+
+  // Consumer only. Keeps a message no handler wanted, or drops it when
+  // selective receive is off.
+  auto stash(MessagePtr msg) -> void {
+    if (_stash_options.capacity == 0) {
+      return;
+    }
+
+    // Coalesced types keep their newest instance in the stash too.
+    if (coalesceSlot(msg->typeId()) != nullptr) {
+      std::erase_if(_stash, [&msg](const Stashed &stashed) {
+        return stashed._msg->typeId() == msg->typeId();
+      });
+    }
+    if (_stash.size() == _stash_options.capacity) {
+      _stash.pop_front();
+    }
+
+    auto max_age = stashAgeOf(msg->typeId());
+    auto now = std::chrono::steady_clock::now();
+    auto expires = now < std::chrono::steady_clock::time_point::max() - max_age
+                       ? now + max_age
+                       : std::chrono::steady_clock::time_point::max();
+    _stash.push_back({std::move(msg), expires});
+  }
+
+  // Consumer only. Takes the oldest stashed message whose type id satisfies
+  // `match`, dropping expired ones on the way.
+  template <typename Match>
+  auto unstash(MessagePtr &msg, Match &&match) -> bool {
+    if (_stash.empty()) {
+      return false;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    std::erase_if(_stash, [now](const Stashed &stashed) {
+      return stashed._expires <= now || stashed._msg->cancelled();
+    });
+    auto it = std::ranges::find_if(_stash, [&match](const Stashed &stashed) {
+      return match(stashed._msg->typeId());
+    });
+    if (it == _stash.end()) {
+      return false;
+    }
+
+    msg = std::move(it->_msg);
+    _stash.erase(it);
+    return true;
+  }
+
+  // Only exact when called from the consumer thread.
+  auto empty() const {
+    auto lock = lockConsumer();
+    return std::ranges::all_of(_lanes,
+                               [](const auto &lane) { return lane.empty(); });
+  }
+
+  // Approximate while producers are running.
+  auto size() const { return _size.load(std::memory_order_relaxed); }
+
+  auto capacity() const { return _options.capacity; }
+
+  auto closed() const { return _closed.load(std::memory_order_acquire); }
+
+  // Runs on the producer after every push and on close, for consumers that
+  // sleep somewhere else than in this queue, e.g. in an event loop. Must be
+  // set before any message is pushed.
+  auto setWaker(std::function<void()> waker) { _waker = std::move(waker); }
+
+  // Records how long each delivered message waited, tagged with its type
+  // id. The consumer is the ring's only writer. Must be set before any
+  // message is pushed.
+  auto recordLatency(std::shared_ptr<LatencyRing> ring) {
+    _latency = std::move(ring);
+  }
+
+  // Wakes the consumer and every sender blocked on a full queue.
+  auto close() {
+    if (_closed.exchange(true, std::memory_order_acq_rel)) {
+      return;
+    }
+
+    _parker->unpark();
+    if (_waker) {
+      _waker();
+    }
+    std::scoped_lock lock{_space_mutex};
+    _space_cond.notify_all();
+  }
+
+  // Returns false if the message was rejected by the overflow policy or the
+  // queue is closed. A coalesced message stays in the lane its queued
+  // predecessor took.
+  auto push(MessagePtr msg, Lane lane = Lane::Normal) -> bool {
+    if (closed()) {
+      return false;
+    }
+
+    if (_latency) {
+      msg->_sent = std::chrono::steady_clock::now();
+    }
+
+    auto *slot = coalesceSlot(msg->typeId());
+    if (slot != nullptr) {
+      // A slot only holds a message once its place in the queue is taken,
+      // so replacing that message never needs a place of its own.
+      auto *stale = slot->_latest.load(std::memory_order_acquire);
+      while (stale != nullptr) {
+        if (slot->_latest.compare_exchange_weak(stale, msg.get(),
+                                                std::memory_order_acq_rel,
+                                                std::memory_order_acquire)) {
+          msg.release();
+          stale->release();
+          return true;
+        }
+      }
+
+      if (!reserve()) {
+        return false;
+      }
+
+      stale = slot->_latest.exchange(msg.release(), std::memory_order_acq_rel);
+      if (stale != nullptr) {
+        // Another producer queued the slot while this one took a place.
+        unreserve();
+        stale->release();
+        return true;
+      }
+
+      laneOf(lane).push(slot);
+    } else {
+      if (!reserve()) {
+        return false;
+      }
+
+      laneOf(lane).push(msg.release());
+    }
+
+    _parker->unpark();
+    if (_waker) {
+      _waker();
+    }
+    return true;
+  }
+
+  // Returns false once the queue is closed and drained.
+  auto waitAndPop(MessagePtr &msg) -> bool {
+    while (!tryPop(msg)) {
+      if (closed()) {
+        return false;
+      }
+      _parker->park([this] { return closed() || !empty(); });
+    }
+    return true;
+  }
+
+  // Returns false once the deadline passed or the queue is closed and
+  // drained.
+  template <typename Clock, typename Duration>
+  auto waitUntil(MessagePtr &msg,
+                 const std::chrono::time_point<Clock, Duration> &deadline)
+      -> bool {
+    while (!tryPop(msg)) {
+      if (closed() || !_parker->parkUntil(deadline, [this] {
+            return closed() || !empty();
+          })) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  template <typename Rep, typename Period>
+  auto waitFor(MessagePtr &msg,
+               const std::chrono::duration<Rep, Period> &timeout) -> bool {
+    return waitUntil(msg, std::chrono::steady_clock::now() + timeout);
+  }
+
+  auto tryPop(MessagePtr &msg) -> bool {
+    for (;;) {
+      Message *node = nullptr;
+      {
+        auto lock = lockConsumer();
+        for (auto lane = _lanes.rbegin(); lane != _lanes.rend(); ++lane) {
+          node = lane->pop();
+          if (node != nullptr) {
+            break;
+          }
+        }
+      }
+      if (node == nullptr) {
+        return false;
+      }
+
+      unreserve();
+      node = unwrap(node);
+      if (node == nullptr) {
+        continue;
+      }
+      if (node->cancelled()) {
+        // Removed before anyone runs it.
+        node->release();
+        continue;
+      }
+
+      delivered(*node);
+      msg.reset(node);
+      return true;
+    }
+  }
+
+  // Consumer only. Pops the next message only if `match` accepts its type
+  // id; a message `match` rejects stays first in line.
+  template <typename Match>
+  auto tryPopIf(MessagePtr &msg, Match &&match) -> bool {
+    for (;;) {
+      Message *node = nullptr;
+      {
+        auto lock = lockConsumer();
+        auto lane = std::ranges::find_if(
+            _lanes.rbegin(), _lanes.rend(),
+            [](const auto &candidate) { return !candidate.empty(); });
+        if (lane == _lanes.rend()) {
+          return false;
+        }
+
+        auto *front = lane->front();
+        if (front == nullptr || !match(deliveredType(*front))) {
+          return false;
+        }
+        node = lane->pop();
+      }
+      if (node == nullptr) {
+        return false;
+      }
+
+      unreserve();
+      node = unwrap(node);
+      if (node == nullptr) {
+        continue;
+      }
+      if (node->cancelled()) {
+        node->release();
+        continue;
+      }
+
+      delivered(*node);
+      msg.reset(node);
+      return true;
+    }
+  }
+
+  auto acquirePool() -> EnvelopePool * {
+    std::scoped_lock lock{_pools_mutex};
+    if (!_idle_pools.empty()) {
+      auto *pool = _idle_pools.back();
+      _idle_pools.pop_back();
+      return pool;
+    }
+
+    return _pools.emplace_back(std::make_unique<EnvelopePool>()).get();
+  }
+
+  auto releasePool(EnvelopePool *pool) {
+    std::scoped_lock lock{_pools_mutex};
+    _idle_pools.push_back(pool);
+  }
+
+private:
+  static constexpr MessageTypeId COALESCE_TYPE_ID =
+      Message::INVALID_TYPE_ID - 1;
+  static constexpr auto NO_MAX_AGE = std::chrono::steady_clock::duration::min();
+
+  struct Stashed {
+    MessagePtr _msg;
+    std::chrono::steady_clock::time_point _expires;
+  };
+
+  // Queued in place of a coalesced message; the consumer takes whatever is
+  // latest when it reaches the slot.
+  struct CoalesceSlot : Message {
+    explicit CoalesceSlot(MessageTypeId delivers)
+        : Message{COALESCE_TYPE_ID}, _delivers{delivers} {}
+
+    MessageTypeId _delivers;
+    std::atomic<Message *> _latest{nullptr};
+  };
+
+  auto coalesceSlot(MessageTypeId type_id) const -> CoalesceSlot * {
+    if (_coalesce.size() <= type_id) {
+      return nullptr;
+    }
+    return _coalesce[type_id].get();
+  }
+
+  // Type of the message a queued node delivers. A slot's latest message
+  // may be replaced and freed by a producer at any time, so it is not read.
+  static auto deliveredType(const Message &node) -> MessageTypeId {
+    if (node.typeId() != COALESCE_TYPE_ID) {
+      return node.typeId();
+    }
+    return static_cast<const CoalesceSlot &>(node)._delivers;
+  }
+
+  // Turns a popped node into the message it delivers, if any.
+  static auto unwrap(Message *node) -> Message * {
+    if (node->typeId() != COALESCE_TYPE_ID) {
+      return node;
+    }
+
+    return static_cast<CoalesceSlot *>(node)->_latest.exchange(
+        nullptr, std::memory_order_acq_rel);
+  }
+
+  auto delivered(const Message &msg) -> void {
+    if (_latency) {
+      _latency->record(static_cast<std::uint32_t>(msg.typeId()),
+                       std::chrono::steady_clock::now() - msg._sent);
+    }
+  }
+
+  // Drop-oldest lets producers evict, so only then do pops need a lock.
+  auto lockConsumer() const -> std::unique_lock<std::mutex> {
+    if (_options.overflow != OverflowPolicy::DropOldest) {
+      return {};
+    }
+    return std::unique_lock{_consumer_mutex};
+  }
+
+  // Takes one place in the queue, applying the overflow policy when full.
+  auto reserve() -> bool {
+    auto size = _size.load(std::memory_order_relaxed);
+    for (;;) {
+      if (size < _options.capacity) {
+        if (_size.compare_exchange_weak(size, size + 1,
+                                        std::memory_order_relaxed)) {
+          return true;
+        }
+        continue;
+      }
+
+      switch (_options.overflow) {
+        case OverflowPolicy::Reject:
+          return false;
+        case OverflowPolicy::DropOldest:
+          evictOldest();
+          break;
+        case OverflowPolicy::Block: {
+          std::unique_lock lock{_space_mutex};
+          _blocked.fetch_add(1, std::memory_order_seq_cst);
+          _space_cond.wait(lock, [this] {
+            return closed() ||
+                   _size.load(std::memory_order_seq_cst) < _options.capacity;
+          });
+          _blocked.fetch_sub(1, std::memory_order_relaxed);
+          if (closed()) {
+            return false;
+          }
+          break;
+        }
+      }
+      size = _size.load(std::memory_order_relaxed);
+    }
+  }
+
+  auto unreserve() -> void {
+    _size.fetch_sub(1, std::memory_order_seq_cst);
+    if (_blocked.load(std::memory_order_seq_cst) != 0) {
+      std::scoped_lock lock{_space_mutex};
+      _space_cond.notify_all();
+    }
+  }
+
+  // Evicts from the lowest non-empty lane.
+  auto evictOldest() -> void {
+    Message *node = nullptr;
+    {
+      auto lock = lockConsumer();
+      for (auto &lane : _lanes) {
+        node = lane.pop();
+        if (node != nullptr) {
+          break;
+        }
+      }
+    }
+    if (node == nullptr) {
+      // Another producer is mid-push; it will be evicted on the next try.
+      return;
+    }
+
+    unreserve();
+    node = unwrap(node);
+    if (node != nullptr) {
+      node->release();
+    }
+  }
+
+  auto stashAgeOf(MessageTypeId type_id) const
+      -> std::chrono::steady_clock::duration {
+    if (_stash_max_age.size() <= type_id ||
+        _stash_max_age[type_id] == NO_MAX_AGE) {
+      return _stash_options.max_age;
+    }
+    return _stash_max_age[type_id];
+  }
+
+  auto laneOf(Lane lane) -> detail::MessageLane & {
+    return _lanes[static_cast<std::size_t>(lane)];
+  }
+
+  QueueOptions _options;
+  std::array<detail::MessageLane, LANE_COUNT> _lanes;
+  std::atomic<std::size_t> _size{0};
+  std::shared_ptr<detail::ConsumerParker> _parker;
+  std::function<void()> _waker;
+  std::shared_ptr<LatencyRing> _latency;
+  std::atomic<bool> _closed{false};
+  mutable std::mutex _consumer_mutex;
+
+  std::vector<std::unique_ptr<CoalesceSlot>> _coalesce;
+
+  StashOptions _stash_options;
+  std::vector<std::chrono::steady_clock::duration> _stash_max_age;
+  std::deque<Stashed> _stash;
+
+  std::mutex _space_mutex;
+  std::condition_variable _space_cond;
+  std::atomic<std::size_t> _blocked{0};
+
+  std::mutex _pools_mutex;
+  std::vector<std::unique_ptr<EnvelopePool>> _pools;
+  std::vector<EnvelopePool *> _idle_pools;
+};
 
 } // namespace srun_gui
 
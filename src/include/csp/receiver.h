@@ -1,51 +1,230 @@
 #ifndef __SRUN_GUI_CSP_RECEIVER_H__
 #define __SRUN_GUI_CSP_RECEIVER_H__
 
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <functional>
 #include <memory>
+#include <new>
+#include <thread>
+#include <type_traits>
 #include <utility>
+#include <vector>
 
 #include "csp/dispatcher.h"
 #include "csp/message.h"
+#include "csp/request.h"
 
 namespace srun_gui {
+// A Sender recycles message storage through its own envelope pool, so a
+// Sender is bound to the thread that first sends through it and can neither
+// be copied nor shared. Ask the Receiver for another Sender for every
+// additional producer thread. Two threads sending through one Sender corrupt
+// the pool; debug builds assert on it, release builds do not notice.
 class Sender {
  public:
   explicit Sender(std::shared_ptr<MessageQueue> _q);
 
+  Sender(const Sender &) = delete;
+
+  Sender(Sender &&) noexcept = delete;
+
+  Sender &operator=(const Sender &) = delete;
+
+  Sender &operator=(Sender &&) noexcept = delete;
+
+  ~Sender();
+
+  // Returns false if the queue rejected the message (OverflowPolicy::Reject)
+  // or is closed.
   template <typename Msg>
-  void send(Msg &&msg);
+  auto send(Msg &&msg,
+            Lane lane = messageLane<std::remove_cvref_t<Msg>>) -> bool;
+
+  // Sends `request` as a Call<Req, Rsp> in the lane of Req. The Future is
+  // broken at once if the queue refused it. `notify` runs once the Future
+  // is ready or broken, e.g. to wake a caller that sleeps in an event loop.
+  template <typename Rsp, typename Req>
+  auto call(Req &&request, std::function<void()> notify = {}) -> Future<Rsp>;
+
+  // See EnvelopePool::heapAllocations.
+  auto heapAllocations() const -> std::size_t {
+    return _pool != nullptr ? _pool->heapAllocations() : 0;
+  }
 
  private:
+  template <typename Msg>
+  auto makeEnvelope(Msg &&msg) -> MessagePtr;
+
+#if !defined(NDEBUG)
+  auto checkOwner() -> void {
+    auto self = std::this_thread::get_id();
+    auto owner = std::thread::id{};
+    if (!_owner.compare_exchange_strong(owner, self,
+                                        std::memory_order_relaxed)) {
+      assert(owner == self && "Sender used from a second thread");
+    }
+  }
+
+  std::atomic<std::thread::id> _owner{};
+#endif
+
   std::shared_ptr<MessageQueue> _q;
+  EnvelopePool *_pool{nullptr};
 };
 
 class Receiver {
  public:
   Receiver();
 
+  explicit Receiver(QueueOptions options);
+
   explicit Receiver(std::shared_ptr<MessageQueue> q);
 
+  // Keep only the newest queued Msg. Call before handing out senders.
+  template <typename Msg>
+  auto coalesce() -> Receiver & {
+    _q->coalesce<Msg>();
+    return *this;
+  }
+
+  // Keep messages the running dispatcher does not handle for a later one.
+  // Call before the first wait.
+  auto selective(StashOptions options) -> Receiver & {
+    _q->selective(options);
+    return *this;
+  }
+
+  // How long a stashed Msg stays worth replaying.
+  template <typename Msg>
+  auto stashMaxAge(std::chrono::steady_clock::duration max_age)
+      -> Receiver & {
+    _q->stashMaxAge<Msg>(max_age);
+    return *this;
+  }
+
+  // See MessageQueue::setWaker. Call before handing out senders.
+  auto setWaker(std::function<void()> waker) -> Receiver & {
+    _q->setWaker(std::move(waker));
+    return *this;
+  }
+
+  // See MessageQueue::recordLatency. Call before handing out senders.
+  auto recordLatency(std::shared_ptr<LatencyRing> ring) -> Receiver & {
+    _q->recordLatency(std::move(ring));
+    return *this;
+  }
+
+  // Messages queued right now; approximate while senders are running.
+  auto size() const { return _q->size(); }
+
   template<bool Blocking>
   auto wait() { return DispatcherHead<Blocking>{_q}; }
 
+  // Blocking dispatch that returns without handling anything once
+  // `deadline` has passed.
+  template <bool Blocking>
+  auto wait(std::chrono::steady_clock::time_point deadline) {
+    return DispatcherHead<Blocking>{_q, deadline};
+  }
+
+  // Non-blocking dispatch that drains up to `budget` queued messages.
+  auto wait(DrainBudget budget) { return DispatcherHead<false>{_q, budget}; }
+
+  // A dispatcher that is built once and pumped many times, see Dispatcher.
+  template <typename... Handlers>
+  auto dispatcher(Handlers... handlers) const {
+    return Dispatcher<Handlers...>{_q, std::move(handlers)...};
+  }
+
   std::unique_ptr<Sender> getSender() const;
 
+  // Consumer only. Moves the messages of the given types that are first in
+  // line into `out`, stopping at the first other message. Nothing queued is
+  // overtaken. Returns the number taken.
+  template <typename... Msgs>
+  auto takeQueued(std::vector<MessagePtr> &out) -> std::size_t {
+    std::size_t taken = 0;
+    MessagePtr msg;
+    while (_q->tryPopIf(msg, [](MessageTypeId type_id) {
+      return ((type_id == messageTypeId<Msgs>()) || ...);
+    })) {
+      out.push_back(std::move(msg));
+      ++taken;
+    }
+    return taken;
+  }
+
+  auto closed() const { return _q->closed(); }
+
+  // Refuses further messages and wakes everything waiting on the queue.
+  auto close() { _q->close(); }
+
  private:
   std::shared_ptr<MessageQueue> _q;
 };
 
-inline Sender::Sender(std::shared_ptr<MessageQueue> q) : _q{std::move(q)} {}
+inline Sender::Sender(std::shared_ptr<MessageQueue> q)
+    : _q{std::move(q)}, _pool{_q ? _q->acquirePool() : nullptr} {}
+
+inline Sender::~Sender() {
+  if (_q) {
+    _q->releasePool(_pool);
+  }
+}
 
 template <typename Msg>
-inline void Sender::send(Msg &&msg) {
+inline auto Sender::send(Msg &&msg, Lane lane) -> bool {
   if (!_q) {
-    return;
+    return false;
+  }
+#if !defined(NDEBUG)
+  checkOwner();
+#endif
+  return _q->push(makeEnvelope(std::forward<Msg>(msg)), lane);
+}
+
+template <typename Rsp, typename Req>
+inline auto Sender::call(Req &&request, std::function<void()> notify)
+    -> Future<Rsp> {
+  using Plain = std::remove_cvref_t<Req>;
+  auto state = std::make_shared<detail::CallState<Rsp>>(
+      detail::nextCorrelationId(), std::move(notify));
+  Future<Rsp> future{state};
+  send(Call<Plain, Rsp>{std::forward<Req>(request), std::move(state)},
+       messageLane<Plain>);
+  return future;
+}
+
+template <typename Msg>
+inline auto Sender::makeEnvelope(Msg &&msg) -> MessagePtr {
+  using Wrapper = MessageWrapper<std::remove_cvref_t<Msg>>;
+  if constexpr (!EnvelopePool::fits(sizeof(Wrapper), alignof(Wrapper))) {
+    return MessagePtr{new Wrapper(std::forward<Msg>(msg))};
+  } else {
+    auto *block = _pool->acquire();
+    Wrapper *wrapper = nullptr;
+#if defined(__cpp_exceptions)
+    try {
+      wrapper = ::new (block) Wrapper(std::forward<Msg>(msg));
+    } catch (...) {
+      _pool->recycle(block);
+      throw;
+    }
+#else
+    wrapper = ::new (block) Wrapper(std::forward<Msg>(msg));
+#endif
+    wrapper->_pool = _pool;
+    return MessagePtr{wrapper};
   }
-  _q->push(std::make_shared<MessageWrapper<Msg>>(std::forward<Msg>(msg)));
 }
 
 inline Receiver::Receiver() : _q{std::make_shared<MessageQueue>()} {}
 
+inline Receiver::Receiver(QueueOptions options)
+    : _q{std::make_shared<MessageQueue>(options)} {}
+
 inline Receiver::Receiver(std::shared_ptr<MessageQueue> q) : _q{std::move(q)} {}
 
 inline std::unique_ptr<Sender> Receiver::getSender() const {
@@ -0,0 +1,294 @@
+#ifndef __SRUN_GUI_CSP_REQUEST_H__
+#define __SRUN_GUI_CSP_REQUEST_H__
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace srun_gui {
+
+// Matches a reply to its request. Unique within the process.
+using CorrelationId = std::uint64_t;
+
+enum class CallStatus : std::uint8_t {
+  Pending,
+  Ready,
+  // The caller gave up; a reply is dropped on arrival.
+  Cancelled,
+  // The request was destroyed without a reply, e.g. its queue was closed.
+  Broken,
+};
+
+namespace detail {
+
+inline auto nextCorrelationId() -> CorrelationId {
+  static std::atomic<CorrelationId> next{1};
+  return next.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Shared by a Call and its Future. Every transition leaves Pending with a
+// CAS, so a reply, a cancel and an abandon race safely and only one wins.
+// `notify` runs after a reply or an abandon, on the thread that made it.
+template <typename Rsp>
+class CallState {
+ public:
+  explicit CallState(CorrelationId id, std::function<void()> notify = {})
+      : _id{id}, _notify{std::move(notify)} {}
+
+  auto id() const { return _id; }
+
+  auto status() const {
+    auto status = _status.load(std::memory_order_acquire);
+    return status == REPLYING ? CallStatus::Pending
+                              : static_cast<CallStatus>(status);
+  }
+
+  auto reply(Rsp &&response) -> bool {
+    if (!leavePending(REPLYING)) {
+      return false;
+    }
+
+    _response.emplace(std::move(response));
+    _status.store(static_cast<std::uint8_t>(CallStatus::Ready),
+                  std::memory_order_release);
+    notify();
+    return true;
+  }
+
+  auto cancel() { return leavePending(CallStatus::Cancelled); }
+
+  auto abandon() {
+    if (!leavePending(CallStatus::Broken)) {
+      return false;
+    }
+
+    notify();
+    return true;
+  }
+
+  // Only after status() returned Ready.
+  auto response() -> Rsp & { return *_response; }
+
+ private:
+  // Between Pending and Ready while the response is written.
+  static constexpr std::uint8_t REPLYING = 0xFF;
+
+  auto notify() const {
+    if (_notify) {
+      _notify();
+    }
+  }
+
+  auto leavePending(CallStatus to) -> bool {
+    return leavePending(static_cast<std::uint8_t>(to));
+  }
+
+  auto leavePending(std::uint8_t to) -> bool {
+    auto expected = static_cast<std::uint8_t>(CallStatus::Pending);
+    return _status.compare_exchange_strong(expected, to,
+                                           std::memory_order_acq_rel);
+  }
+
+  CorrelationId _id;
+  std::function<void()> _notify;
+  std::atomic<std::uint8_t> _status{
+      static_cast<std::uint8_t>(CallStatus::Pending)};
+  std::optional<Rsp> _response;
+};
+
+}  // namespace detail
+
+// The message a `Sender::call` delivers. The handler answers with `reply`;
+// dropping it unanswered breaks the caller's Future.
+template <typename Req, typename Rsp>
+class Call {
+ public:
+  Call(Req request, std::shared_ptr<detail::CallState<Rsp>> state)
+      : _request{std::move(request)}, _state{std::move(state)} {}
+
+  Call(const Call &) = delete;
+
+  Call(Call &&) noexcept = default;
+
+  Call &operator=(const Call &) = delete;
+
+  Call &operator=(Call &&) noexcept = default;
+
+  ~Call() {
+    if (_state) {
+      _state->abandon();
+    }
+  }
+
+  auto id() const { return _state->id(); }
+
+  auto request() const -> const Req & { return _request; }
+
+  // The handler may skip the work when nobody waits for the answer.
+  auto cancelled() const {
+    return _state->status() == CallStatus::Cancelled;
+  }
+
+  // Returns false if the reply was dropped because the caller cancelled or
+  // the call was answered already.
+  auto reply(Rsp response) const -> bool {
+    return _state->reply(std::move(response));
+  }
+
+ private:
+  Req _request;
+  std::shared_ptr<detail::CallState<Rsp>> _state;
+};
+
+// The caller's end of a Call. Poll it with `ready`; destroying a pending
+// Future cancels the call.
+template <typename Rsp>
+class Future {
+ public:
+  Future() = default;
+
+  explicit Future(std::shared_ptr<detail::CallState<Rsp>> state)
+      : _state{std::move(state)} {}
+
+  Future(const Future &) = delete;
+
+  Future(Future &&) noexcept = default;
+
+  Future &operator=(const Future &) = delete;
+
+  Future &operator=(Future &&other) noexcept {
+    if (this != &other) {
+      cancel();
+      _state = std::move(other._state);
+    }
+    return *this;
+  }
+
+  ~Future() { cancel(); }
+
+  auto valid() const { return _state != nullptr; }
+
+  auto id() const { return _state->id(); }
+
+  auto status() const { return _state->status(); }
+
+  auto ready() const { return status() == CallStatus::Ready; }
+
+  // Only once ready.
+  auto get() -> Rsp & { return _state->response(); }
+
+  // Returns false if the call was no longer pending.
+  auto cancel() -> bool { return _state && _state->cancel(); }
+
+ private:
+  std::shared_ptr<detail::CallState<Rsp>> _state;
+};
+
+// Runs completion callbacks on the caller's thread. Call `poll` from the
+// loop that owns it, e.g. once per frame.
+class PendingCalls {
+ public:
+  // `on_reply(Rsp &)` runs from `poll` once the reply is there. Calls that
+  // are cancelled or broken are dropped without running it.
+  template <typename Rsp, typename OnReply>
+  auto add(Future<Rsp> future, OnReply &&on_reply) -> CorrelationId {
+    auto id = future.id();
+    _calls.push_back(
+        std::make_unique<Entry<Rsp, std::decay_t<OnReply>>>(
+            std::move(future), std::forward<OnReply>(on_reply)));
+    return id;
+  }
+
+  auto contains(CorrelationId id) const {
+    return std::ranges::any_of(
+        _calls, [id](const auto &call) { return call->id() == id; });
+  }
+
+  // Returns false if the call already completed.
+  auto cancel(CorrelationId id) -> bool {
+    auto it = std::ranges::find_if(
+        _calls, [id](const auto &call) { return call->id() == id; });
+    if (it == _calls.end()) {
+      return false;
+    }
+
+    auto cancelled = (*it)->cancel();
+    _calls.erase(it);
+    return cancelled;
+  }
+
+  auto size() const { return _calls.size(); }
+
+  // Returns the number of callbacks run.
+  auto poll() -> std::size_t {
+    std::size_t done = 0;
+    // Callbacks may add calls, so entries are taken out before they run.
+    for (std::size_t i = 0; i < _calls.size();) {
+      auto status = _calls[i]->status();
+      if (status == CallStatus::Pending) {
+        ++i;
+        continue;
+      }
+
+      auto call = std::move(_calls[i]);
+      _calls.erase(_calls.begin() + static_cast<std::ptrdiff_t>(i));
+      if (status == CallStatus::Ready) {
+        call->complete();
+        ++done;
+      }
+    }
+    return done;
+  }
+
+ private:
+  struct PendingCall {
+    PendingCall() = default;
+
+    PendingCall(const PendingCall &) = delete;
+
+    PendingCall(PendingCall &&) noexcept = delete;
+
+    PendingCall &operator=(const PendingCall &) = delete;
+
+    PendingCall &operator=(PendingCall &&) noexcept = delete;
+
+    virtual ~PendingCall() = default;
+
+    virtual auto id() const -> CorrelationId = 0;
+
+    virtual auto status() const -> CallStatus = 0;
+
+    virtual auto cancel() -> bool = 0;
+
+    virtual auto complete() -> void = 0;
+  };
+
+  template <typename Rsp, typename OnReply>
+  struct Entry : PendingCall {
+    Entry(Future<Rsp> future, OnReply on_reply)
+        : _future{std::move(future)}, _on_reply{std::move(on_reply)} {}
+
+    auto id() const -> CorrelationId override { return _future.id(); }
+
+    auto status() const -> CallStatus override { return _future.status(); }
+
+    auto cancel() -> bool override { return _future.cancel(); }
+
+    auto complete() -> void override { _on_reply(_future.get()); }
+
+    Future<Rsp> _future;
+    OnReply _on_reply;
+  };
+
+  std::vector<std::unique_ptr<PendingCall>> _calls;
+};
+
+}  // namespace srun_gui
+
+#endif  // __SRUN_GUI_CSP_REQUEST_H__
@@ -0,0 +1,77 @@
+#ifndef __SRUN_GUI_CSP_SAMPLE_RING_H__
+#define __SRUN_GUI_CSP_SAMPLE_RING_H__
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace srun_gui {
+
+// The most recent samples of one measurement, e.g. message latencies, each
+// a tag (what was measured) and a value in microseconds.
+//
+// One thread records, any thread reads, and neither ever waits: the writer
+// stores into the oldest slot and publishes its count. A reader that races
+// with the writer may see a slot's newer sample instead of the one it
+// expected, which is harmless for statistics.
+template <std::size_t N = 256>
+class SampleRing {
+ public:
+  static constexpr std::size_t CAPACITY = N;
+
+  struct Sample {
+    std::uint32_t _tag;
+    std::uint32_t _micros;
+  };
+
+  // Writer thread only.
+  auto record(std::uint32_t tag, std::uint32_t micros) noexcept {
+    auto written = _written.load(std::memory_order_relaxed);
+    _slots[written % N].store(
+        (static_cast<std::uint64_t>(tag) << 32U) | micros,
+        std::memory_order_relaxed);
+    _written.store(written + 1, std::memory_order_release);
+  }
+
+  // Writer thread only. Longer durations are clamped.
+  template <typename Rep, typename Period>
+  auto record(std::uint32_t tag,
+              std::chrono::duration<Rep, Period> duration) noexcept {
+    auto micros =
+        std::chrono::duration_cast<std::chrono::microseconds>(duration)
+            .count();
+    record(tag, static_cast<std::uint32_t>(std::clamp<decltype(micros)>(
+                    micros, 0, std::numeric_limits<std::uint32_t>::max())));
+  }
+
+  // Replaces `out` with the recorded samples, oldest first. Reuses its
+  // storage, so readers that keep `out` do not allocate.
+  auto snapshot(std::vector<Sample>& out) const {
+    out.clear();
+    auto written = _written.load(std::memory_order_acquire);
+    for (auto i = written - std::min<std::size_t>(written, N); i < written;
+         ++i) {
+      auto packed = _slots[i % N].load(std::memory_order_relaxed);
+      out.push_back({static_cast<std::uint32_t>(packed >> 32U),
+                     static_cast<std::uint32_t>(packed)});
+    }
+  }
+
+  // Samples ever recorded, including those already overwritten.
+  auto recorded() const { return _written.load(std::memory_order_acquire); }
+
+ private:
+  std::array<std::atomic<std::uint64_t>, N> _slots{};
+  std::atomic<std::size_t> _written{0};
+};
+
+using LatencyRing = SampleRing<>;
+
+}  // namespace srun_gui
+
+#endif  // __SRUN_GUI_CSP_SAMPLE_RING_H__
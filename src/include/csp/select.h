@@ -0,0 +1,109 @@
+#ifndef __SRUN_GUI_CSP_SELECT_H__
+#define __SRUN_GUI_CSP_SELECT_H__
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "csp/consumer_parker.h"
+#include "csp/message.h"
+#include "csp/receiver.h"
+
+namespace srun_gui {
+
+// Blocks on several channels at once, like Go's `select`.
+//
+// Channels are created by the Select and numbered in creation order. Their
+// queues share one parker, so a push into any of them wakes the selecting
+// thread directly. All channels must be consumed on that thread.
+class Select {
+ public:
+  Select() : _parker{std::make_shared<detail::ConsumerParker>()} {}
+
+  // Higher priority channels are picked first when several are ready;
+  // channels of equal priority take turns.
+  auto channel(int priority = 0, QueueOptions options = {}) -> Receiver {
+    auto q = std::make_shared<MessageQueue>(options, _parker);
+    _channels.push_back({q, priority});
+    return Receiver{std::move(q)};
+  }
+
+  auto size() const { return _channels.size(); }
+
+  // Index of a channel that has a message, if any. A closed channel counts
+  // as ready so that its waiters see the close.
+  auto tryReady() -> std::optional<std::size_t> {
+    std::optional<std::size_t> best;
+    for (std::size_t n = 0; n < _channels.size(); ++n) {
+      auto i = (_next + n) % _channels.size();
+      if (!_channels[i].ready()) {
+        continue;
+      }
+
+      if (!best || _channels[*best]._priority < _channels[i]._priority) {
+        best = i;
+      }
+    }
+
+    if (best) {
+      _next = *best + 1;
+    }
+    return best;
+  }
+
+  auto wait() -> std::size_t {
+    for (;;) {
+      if (auto ready = tryReady()) {
+        return *ready;
+      }
+      _parker->park([this] { return anyReady(); });
+    }
+  }
+
+  template <typename Clock, typename Duration>
+  auto waitUntil(const std::chrono::time_point<Clock, Duration>& deadline)
+      -> std::optional<std::size_t> {
+    for (;;) {
+      if (auto ready = tryReady()) {
+        return ready;
+      }
+      if (!_parker->parkUntil(deadline, [this] { return anyReady(); })) {
+        return std::nullopt;
+      }
+    }
+  }
+
+  template <typename Rep, typename Period>
+  auto waitFor(const std::chrono::duration<Rep, Period>& timeout)
+      -> std::optional<std::size_t> {
+    return waitUntil(std::chrono::steady_clock::now() + timeout);
+  }
+
+ private:
+  struct Channel {
+    std::shared_ptr<MessageQueue> _q;
+    int _priority;
+
+    auto ready() const -> bool { return _q->closed() || !_q->empty(); }
+  };
+
+  auto anyReady() const -> bool {
+    for (const auto& channel : _channels) {
+      if (channel.ready()) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  std::shared_ptr<detail::ConsumerParker> _parker;
+  std::vector<Channel> _channels;
+  std::size_t _next{0};
+};
+
+}  // namespace srun_gui
+
+#endif  // __SRUN_GUI_CSP_SELECT_H__
@@ -0,0 +1,44 @@
+#ifndef __SRUN_GUI_CSP_SINGLE_FLIGHT_H__
+#define __SRUN_GUI_CSP_SINGLE_FLIGHT_H__
+
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+#include "csp/message.h"
+
+namespace srun_gui {
+
+// Counts how single-flight execution pays off, per request type: every
+// execution served `1 + joined` requests, so `joined` calls were saved.
+class FlightCounters {
+ public:
+  struct Counts {
+    std::uint64_t executions{0};
+    std::uint64_t joined{0};
+  };
+
+  // `waiters` is the number of requests one execution served.
+  template <typename Msg>
+  auto record(std::size_t waiters) {
+    std::scoped_lock lock{_m};
+    auto &counts = _counts[messageTypeId<Msg>()];
+    ++counts.executions;
+    counts.joined += waiters - 1;
+  }
+
+  template <typename Msg>
+  auto counts() const -> Counts {
+    std::scoped_lock lock{_m};
+    auto it = _counts.find(messageTypeId<Msg>());
+    return it == _counts.end() ? Counts{} : it->second;
+  }
+
+ private:
+  mutable std::mutex _m;
+  std::unordered_map<MessageTypeId, Counts> _counts;
+};
+
+}  // namespace srun_gui
+
+#endif  // __SRUN_GUI_CSP_SINGLE_FLIGHT_H__
@@ -0,0 +1,153 @@
+#ifndef __SRUN_GUI_CSP_THREAD_POOL_H__
+#define __SRUN_GUI_CSP_THREAD_POOL_H__
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace srun_gui {
+
+// A fixed number of workers, each with its own task deque. A worker runs its
+// newest task first and, when it has none, steals the oldest task of another
+// worker, so a burst submitted to one worker spreads over the idle ones.
+//
+// Tasks get the index of the worker that runs them, e.g. to pick a
+// per-worker Sender.
+class ThreadPool {
+ public:
+  using Task = std::function<void(std::size_t worker)>;
+
+  explicit ThreadPool(std::size_t threads) {
+    threads = std::max<std::size_t>(threads, 1);
+    for (std::size_t i = 0; i < threads; ++i) {
+      _workers.push_back(std::make_unique<Worker>());
+    }
+    for (std::size_t i = 0; i < threads; ++i) {
+      _threads.emplace_back([this, i] { loop(i); });
+    }
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+
+  ThreadPool(ThreadPool &&) noexcept = delete;
+
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  ThreadPool &operator=(ThreadPool &&) noexcept = delete;
+
+  // Runs the tasks already submitted, then joins the workers.
+  ~ThreadPool() {
+    {
+      std::scoped_lock lock{_sleep_mutex};
+      _stop = true;
+    }
+    _sleep_cond.notify_all();
+    for (auto &thread : _threads) {
+      thread.join();
+    }
+  }
+
+  auto size() const { return _workers.size(); }
+
+  // From a worker the task goes to that worker's own deque, otherwise the
+  // workers take turns.
+  auto submit(Task task) {
+    auto index = current_pool == this
+                     ? current_worker
+                     : _next.fetch_add(1, std::memory_order_relaxed) %
+                           _workers.size();
+    // Counted first, so a worker that takes the task at once never sees
+    // the count drop below zero.
+    {
+      std::scoped_lock lock{_sleep_mutex};
+      _queued.fetch_add(1, std::memory_order_relaxed);
+    }
+    {
+      auto &worker = *_workers[index];
+      std::scoped_lock lock{worker._m};
+      worker._tasks.push_back(std::move(task));
+    }
+    _sleep_cond.notify_one();
+  }
+
+ private:
+  struct Worker {
+    std::mutex _m;
+    std::deque<Task> _tasks;
+  };
+
+  void loop(std::size_t index) {
+    current_pool = this;
+    current_worker = index;
+    Task task;
+    for (;;) {
+      if (popLocal(index, task) || steal(index, task)) {
+        _queued.fetch_sub(1, std::memory_order_relaxed);
+        task(index);
+        task = nullptr;
+        continue;
+      }
+
+      std::unique_lock lock{_sleep_mutex};
+      _sleep_cond.wait(lock, [this] {
+        return _stop || _queued.load(std::memory_order_relaxed) != 0;
+      });
+      if (_stop && _queued.load(std::memory_order_relaxed) == 0) {
+        return;
+      }
+    }
+  }
+
+  auto popLocal(std::size_t index, Task &task) -> bool {
+    auto &worker = *_workers[index];
+    std::scoped_lock lock{worker._m};
+    if (worker._tasks.empty()) {
+      return false;
+    }
+
+    task = std::move(worker._tasks.back());
+    worker._tasks.pop_back();
+    return true;
+  }
+
+  auto steal(std::size_t thief, Task &task) -> bool {
+    for (std::size_t n = 1; n < _workers.size(); ++n) {
+      auto &victim = *_workers[(thief + n) % _workers.size()];
+      std::scoped_lock lock{victim._m};
+      if (victim._tasks.empty()) {
+        continue;
+      }
+
+      task = std::move(victim._tasks.front());
+      victim._tasks.pop_front();
+      return true;
+    }
+    return false;
+  }
+
+  static inline thread_local ThreadPool *current_pool{nullptr};
+  static inline thread_local std::size_t current_worker{0};
+
+  std::vector<std::unique_ptr<Worker>> _workers;
+  std::atomic<std::size_t> _next{0};
+
+  std::mutex _sleep_mutex;
+  std::condition_variable _sleep_cond;
+  // Submitted and not yet taken; workers only sleep while it is zero.
+  std::atomic<std::size_t> _queued{0};
+  bool _stop{false};
+
+  std::vector<std::thread> _threads;
+};
+
+}  // namespace srun_gui
+
+#endif  // __SRUN_GUI_CSP_THREAD_POOL_H__
@@ -2,6 +2,7 @@
 #define __SRUN_GUI_CSP_THREAD_SAFE_QUEUE_H__
 
 #include <algorithm>
+#include <chrono>
 #include <condition_variable>
 #include <exception>
 #include <memory>
@@ -11,6 +12,8 @@
 
 namespace srun_gui {
 
+// A closed queue refuses new values; what is already queued can still be
+// popped, after which waits return false (or null) instead of blocking.
 template <typename T> class ThreadSafeQueue {
 public:
   ThreadSafeQueue() = default;
@@ -18,11 +21,13 @@ public:
   ThreadSafeQueue(const ThreadSafeQueue<T> &other) {
     std::scoped_lock lock{other._m};
     _data = other._data;
+    _closed = other._closed;
   }
 
   ThreadSafeQueue(ThreadSafeQueue<T> &&other) noexcept {
     std::scoped_lock lock{other._m};
     _data = std::move(other._data);
+    _closed = other._closed;
   }
 
   ThreadSafeQueue<T> &operator=(const ThreadSafeQueue<T> &other) = delete;
@@ -41,22 +46,62 @@ public:
     return _data.size();
   }
 
-  auto push(T value) {
+  auto closed() const {
     std::scoped_lock lock{_m};
+    return _closed;
+  }
+
+  // Wakes every blocked waiter at once.
+  auto close() {
+    {
+      std::scoped_lock lock{_m};
+      _closed = true;
+    }
+    _cond.notify_all();
+  }
+
+  // Returns false if the queue is closed.
+  auto push(T value) -> bool {
+    std::scoped_lock lock{_m};
+    if (_closed) {
+      return false;
+    }
     _data.push(std::move(value));
     _cond.notify_one();
+    return true;
   }
 
-  auto waitAndPop(T &value) {
+  // Returns false once the queue is closed and drained.
+  auto waitAndPop(T &value) -> bool {
     std::unique_lock lock{_m};
-    _cond.wait(lock, [this] { return !_data.empty(); });
-    try {
-      value = std::move(_data.front());
-      _data.pop();
-    } catch (const std::exception &e) {
-      _cond.notify_one();
-      throw e;
+    _cond.wait(lock, [this] { return _closed || !_data.empty(); });
+    if (_data.empty()) {
+      return false;
+    }
+    popFront(value);
+    return true;
+  }
+
+  // Returns false once the deadline passed or the queue is closed and
+  // drained.
+  template <typename Clock, typename Duration>
+  auto waitUntil(T &value,
+                 const std::chrono::time_point<Clock, Duration> &deadline)
+      -> bool {
+    std::unique_lock lock{_m};
+    if (!_cond.wait_until(lock, deadline,
+                          [this] { return _closed || !_data.empty(); }) ||
+        _data.empty()) {
+      return false;
     }
+    popFront(value);
+    return true;
+  }
+
+  template <typename Rep, typename Period>
+  auto waitFor(T &value, const std::chrono::duration<Rep, Period> &timeout)
+      -> bool {
+    return waitUntil(value, std::chrono::steady_clock::now() + timeout);
   }
 
   auto tryPop(T &value) -> bool {
@@ -69,17 +114,27 @@ public:
     return true;
   }
 
+  // Returns null once the queue is closed and drained.
   auto waitAndPop() -> std::unique_ptr<T> {
     std::unique_lock lock{_m};
-    _cond.wait(lock, [this] { return !_data.empty(); });
+    _cond.wait(lock, [this] { return _closed || !_data.empty(); });
+    if (_data.empty()) {
+      return std::unique_ptr<T>{};
+    }
+#if defined(__cpp_exceptions)
     try {
       auto res = std::make_unique<T>(std::move(_data.front()));
       _data.pop();
       return res;
-    } catch (const std::exception &e) {
+    } catch (...) {
       _cond.notify_one();
-      throw e;
+      throw;
     }
+#else
+    auto res = std::make_unique<T>(std::move(_data.front()));
+    _data.pop();
+    return res;
+#endif
   }
 
   auto tryPop() -> std::unique_ptr<T> {
@@ -93,9 +148,26 @@ public:
   }
 
 private:
+  // Called with `_m` held. If the move throws, the value stays queued and
+  // another waiter is woken to retry.
+  auto popFront(T &value) {
+#if defined(__cpp_exceptions)
+    try {
+      value = std::move(_data.front());
+    } catch (...) {
+      _cond.notify_one();
+      throw;
+    }
+#else
+    value = std::move(_data.front());
+#endif
+    _data.pop();
+  }
+
   mutable std::mutex _m{};
   std::condition_variable _cond{};
   std::queue<T> _data{};
+  bool _closed{false};
 };
 
 } // namespace srun_gui
@@ -0,0 +1,139 @@
+#ifndef __SRUN_GUI_CSP_TIMER_SERVICE_H__
+#define __SRUN_GUI_CSP_TIMER_SERVICE_H__
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "csp/receiver.h"
+
+namespace srun_gui {
+
+using TimerId = std::uint64_t;
+
+// Delivered to the receiver a timer was scheduled for.
+struct TimerFired {
+  TimerId id{};
+  std::chrono::steady_clock::time_point deadline;
+};
+
+// Delivers TimerFired messages into message queues. All timers share one
+// thread and a min-heap of deadlines, so a timer costs a heap entry and a
+// Sender, never a thread.
+class TimerService {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  TimerService() : _thread{[this] { loop(); }} {}
+
+  TimerService(const TimerService &) = delete;
+
+  TimerService(TimerService &&) noexcept = delete;
+
+  TimerService &operator=(const TimerService &) = delete;
+
+  TimerService &operator=(TimerService &&) noexcept = delete;
+
+  ~TimerService() {
+    {
+      std::scoped_lock lock{_m};
+      _stop = true;
+    }
+    _cond.notify_one();
+    _thread.join();
+  }
+
+  // Fires once after `delay`, then every `period` if it is non-zero.
+  auto schedule(const Receiver &target, Clock::duration delay,
+                Clock::duration period = Clock::duration::zero())
+      -> TimerId {
+    auto sender = target.getSender();
+    std::scoped_lock lock{_m};
+    auto id = ++_last_id;
+    auto deadline = Clock::now() + delay;
+    _timers.emplace(id, Timer{std::move(sender), period});
+    _deadlines.push({deadline, id});
+    _cond.notify_one();
+    return id;
+  }
+
+  // Returns false if the timer already fired for the last time.
+  auto cancel(TimerId id) -> bool {
+    std::scoped_lock lock{_m};
+    return _timers.erase(id) != 0;
+  }
+
+ private:
+  struct Timer {
+    std::unique_ptr<Sender> _sender;
+    Clock::duration _period;
+  };
+
+  struct Deadline {
+    Clock::time_point _when;
+    TimerId _id;
+
+    auto operator>(const Deadline &other) const {
+      return _when > other._when;
+    }
+  };
+
+  void loop() {
+    std::unique_lock lock{_m};
+    while (!_stop) {
+      if (_deadlines.empty()) {
+        _cond.wait(lock);
+        continue;
+      }
+
+      auto next = _deadlines.top();
+      if (Clock::now() < next._when) {
+        _cond.wait_until(lock, next._when);
+        continue;
+      }
+
+      _deadlines.pop();
+      auto it = _timers.find(next._id);
+      if (it == _timers.end()) {
+        // Cancelled; its heap entry is dropped lazily.
+        continue;
+      }
+
+      // Senders are only ever used on this thread.
+      it->second._sender->send(TimerFired{next._id, next._when});
+      if (it->second._period == Clock::duration::zero()) {
+        _timers.erase(it);
+        continue;
+      }
+
+      // Skip the periods that were missed instead of firing a burst.
+      auto when = next._when + it->second._period;
+      auto now = Clock::now();
+      if (when <= now) {
+        when += ((now - when) / it->second._period + 1) * it->second._period;
+      }
+      _deadlines.push({when, next._id});
+    }
+  }
+
+  std::mutex _m;
+  std::condition_variable _cond;
+  bool _stop{false};
+  TimerId _last_id{0};
+  std::unordered_map<TimerId, Timer> _timers;
+  std::priority_queue<Deadline, std::vector<Deadline>, std::greater<>>
+      _deadlines;
+  std::thread _thread;
+};
+
+}  // namespace srun_gui
+
+#endif  // __SRUN_GUI_CSP_TIMER_SERVICE_H__
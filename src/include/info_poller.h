@@ -0,0 +1,59 @@
+#ifndef __SRUN_GUI_INFO_POLLER_H__
+#define __SRUN_GUI_INFO_POLLER_H__
+
+#include <chrono>
+#include <optional>
+#include <random>
+#include <string>
+
+#include "common/msg.h"
+
+namespace srun_gui {
+
+struct PollOptions {
+  std::chrono::milliseconds interval{std::chrono::seconds{5}};
+  std::chrono::milliseconds min_interval{std::chrono::seconds{1}};
+  std::chrono::milliseconds max_interval{std::chrono::seconds{60}};
+  // Used while the window is hidden, unless the interval is longer.
+  std::chrono::milliseconds hidden_interval{std::chrono::seconds{60}};
+  // Traffic (bytes in and out per second) at which polling speeds up.
+  double fast_rate{256.0 * 1024};
+  // Every delay is scaled by a random factor within 1 +- jitter, so many
+  // clients do not poll the portal in lockstep.
+  double jitter{0.1};
+};
+
+// Decides when to poll info next. Unchanged results double the interval up
+// to max_interval, fast moving counters halve it down to min_interval and
+// any other change resets it to the base interval.
+class InfoPoller {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit InfoPoller(PollOptions options = {});
+
+  auto setHidden(bool hidden) { _hidden = hidden; }
+
+  // Returns true if `info` differs from the previous result.
+  auto onResult(const DrawInfo& info, Clock::time_point now) -> bool;
+
+  auto nextDelay() -> Clock::duration;
+
+  auto interval() const { return _interval; }
+
+ private:
+  PollOptions _options;
+  Clock::duration _interval;
+  bool _hidden{false};
+
+  bool _has_last{false};
+  std::optional<std::string> _last_err;
+  UserInfo _last_info;
+  Clock::time_point _last_at;
+
+  std::mt19937 _rng{std::random_device{}()};
+};
+
+}  // namespace srun_gui
+
+#endif  // __SRUN_GUI_INFO_POLLER_H__
@@ -0,0 +1,76 @@
+#ifndef __SRUN_GUI_PERF_OVERLAY_H__
+#define __SRUN_GUI_PERF_OVERLAY_H__
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "csp/message.h"
+#include "csp/sample_ring.h"
+
+namespace srun_gui {
+
+// A window with frame times, the time Ui::action takes, queue depths, how
+// long each message type waited in each queue, and recent portal calls. F12
+// shows and hides it.
+//
+// Every number comes from a SampleRing that its own thread writes, so
+// recording costs a clock read and an atomic store, and a hidden overlay
+// costs only the key check.
+class PerfOverlay {
+ public:
+  PerfOverlay();
+
+  // `depth` is called on the ui thread while the overlay shows. `latency`
+  // must outlive the overlay.
+  auto addQueue(std::string name, std::function<std::size_t()> depth,
+                const LatencyRing& latency) -> void;
+
+  // `names` label the tags of `calls`, which must outlive the overlay.
+  auto setPortalCalls(const LatencyRing& calls,
+                      std::vector<std::string> names) -> void;
+
+  // Ui thread, once per drawn frame.
+  auto recordFrame(std::chrono::steady_clock::duration frame,
+                   std::chrono::steady_clock::duration action) {
+    _frame_times.record(0, frame);
+    _action_times.record(0, action);
+  }
+
+  auto visible() const { return _visible; }
+
+  // Inside an ImGui frame, after the ui drew.
+  auto draw() -> void;
+
+ private:
+  struct Queue {
+    std::string _name;
+    std::function<std::size_t()> _depth;
+    const LatencyRing* _latency;
+  };
+
+  using Sample = LatencyRing::Sample;
+
+  auto drawQueue(const Queue& queue) -> void;
+
+  auto drawPortalCalls() -> void;
+
+  auto messageName(std::uint32_t type_id) const -> const char*;
+
+  bool _visible{false};
+  LatencyRing _frame_times;
+  LatencyRing _action_times;
+  std::vector<Queue> _queues;
+  const LatencyRing* _portal_calls{nullptr};
+  std::vector<std::string> _portal_names;
+  std::map<MessageTypeId, std::string> _message_names;
+  // Reused by every snapshot, so a shown overlay does not allocate either.
+  std::vector<Sample> _samples;
+};
+
+}  // namespace srun_gui
+
+#endif  // __SRUN_GUI_PERF_OVERLAY_H__
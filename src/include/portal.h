@@ -0,0 +1,37 @@
+#ifndef __SRUN_GUI_PORTAL_H__
+#define __SRUN_GUI_PORTAL_H__
+
+#include <srun/srun.h>
+
+#include <functional>
+#include <string>
+#include <string_view>
+
+#include "common/msg.h"
+#include "csp/cancel.h"
+
+namespace srun_gui {
+
+// Portal operations on one client, shared by the backend's own client and
+// the SessionManager accounts. Portal errors end up in the reported message.
+
+auto configureClient(srun::SrunClient& client, const Config& config) -> void;
+
+// Throws srun::SrunException if the file cannot be read.
+auto readConfigFile(std::string_view config_file) -> Config;
+
+// Clients with the same key talk to the same portal.
+auto portalKey(const Config& config) -> std::string;
+
+// Reports progress and the result. Stops before the portal login if
+// `cancel` fires during the online check.
+auto loginClient(srun::SrunClient& client, const CancelToken& cancel,
+                 const std::function<void(DrawLogin)>& report) -> void;
+
+auto fetchInfo(srun::SrunClient& client) -> DrawInfo;
+
+auto logoutClient(srun::SrunClient& client) -> DrawLogout;
+
+}  // namespace srun_gui
+
+#endif  // __SRUN_GUI_PORTAL_H__
@@ -0,0 +1,153 @@
+#ifndef __SRUN_GUI_SESSION_MANAGER_H__
+#define __SRUN_GUI_SESSION_MANAGER_H__
+
+#include <srun/srun.h>
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "common/msg.h"
+#include "csp/cancel.h"
+#include "csp/receiver.h"
+#include "csp/thread_pool.h"
+#include "csp/timer_service.h"
+#include "watchdog.h"
+
+namespace srun_gui {
+
+struct SessionOptions {
+  std::size_t threads{4};
+  // Operations running at once against one portal, over all its accounts.
+  std::size_t per_portal_limit{2};
+  // Every account gets its own, from a successful login until logout.
+  WatchdogOptions watchdog{};
+};
+
+// Keeps one srun::SrunClient per account and runs their operations on a
+// ThreadPool. Operations of one account run in order, one at a time;
+// different accounts run concurrently up to the portal limit. Results are
+// reported as DrawAccount messages.
+//
+// A watchdog keeps each logged in account online. Its checks and re-logins
+// are operations of the account like any other; a re-login is reported.
+class SessionManager {
+ public:
+  using SenderFactory = std::function<std::unique_ptr<Sender>()>;
+
+  // `make_sender` is called once per pool worker.
+  explicit SessionManager(const SenderFactory& make_sender,
+                          SessionOptions options = {});
+
+  SessionManager(const SessionManager&) = delete;
+
+  SessionManager(SessionManager&&) noexcept = delete;
+
+  SessionManager& operator=(const SessionManager&) = delete;
+
+  SessionManager& operator=(SessionManager&&) noexcept = delete;
+
+  ~SessionManager();
+
+  // Return false if the account already exists.
+  auto add(const std::string& account, const Config& config) -> bool;
+
+  // Operations already running finish, queued ones are dropped.
+  auto remove(const std::string& account) -> bool;
+
+  // Queue an operation. Return false if the account does not exist.
+  auto login(const std::string& account, CancelToken cancel = {}) -> bool;
+
+  auto getInfo(const std::string& account, CancelToken cancel = {}) -> bool;
+
+  auto logout(const std::string& account, CancelToken cancel = {}) -> bool;
+
+  auto accounts() const -> std::vector<std::string>;
+
+ private:
+  enum class OpKind { Login, Info, Logout, Watch };
+
+  struct Op {
+    OpKind _kind{OpKind::Login};
+    CancelToken _cancel;
+  };
+
+  struct Session {
+    std::string _account;
+    std::string _portal;
+    srun::SrunClient _client;
+    std::deque<Op> _ops;
+    // Touched only by the task holding `_running`, like `_client`.
+    Watchdog _watchdog;
+    // Under _m.
+    std::optional<TimerId> _watch_timer;
+    bool _running{false};
+    bool _waiting{false};
+    bool _removed{false};
+  };
+
+  struct Portal {
+    std::size_t _active{0};
+    // Sessions with queued operations, in the order they asked.
+    std::deque<std::shared_ptr<Session>> _waiting;
+  };
+
+  auto enqueue(const std::string& account, Op op) -> bool;
+
+  // The caller holds _m.
+  auto push(const std::shared_ptr<Session>& session, Op op) -> void;
+
+  // The caller holds _m.
+  auto schedule(const std::shared_ptr<Session>& session) -> void;
+
+  // The caller holds _m. Starts waiting sessions while the portal has room.
+  auto startWaiting(Portal& portal) -> void;
+
+  // Runs one operation, so a busy account cannot starve the others.
+  auto runOne(const std::shared_ptr<Session>& session, std::size_t worker)
+      -> void;
+
+  auto execute(const std::shared_ptr<Session>& session, const Op& op,
+               Sender& report) -> void;
+
+  // Runs what the watchdog asks for and schedules its next turn.
+  auto watch(const std::shared_ptr<Session>& session, Sender& report) -> void;
+
+  auto scheduleWatch(const std::shared_ptr<Session>& session,
+                     Watchdog::Clock::duration delay) -> void;
+
+  auto stopWatch(Session& session) -> void;
+
+  // The caller holds _m.
+  auto cancelWatch(Session& session) -> void;
+
+  // Turns fired watchdog timers into Watch operations.
+  auto watchLoop() -> void;
+
+  SessionOptions _options;
+  // One per pool worker, indexed by the worker running the task.
+  std::vector<std::unique_ptr<Sender>> _reports;
+
+  mutable std::mutex _m;
+  std::unordered_map<std::string, std::shared_ptr<Session>> _sessions;
+  std::unordered_map<std::string, Portal> _portals;
+  std::unordered_map<TimerId, std::shared_ptr<Session>> _watch_timers;
+
+  Receiver _watch;
+  TimerService _timers;
+  std::thread _watcher;
+
+  // Last, so it is joined before the state its tasks use goes away.
+  ThreadPool _pool;
+};
+
+}  // namespace srun_gui
+
+#endif  // __SRUN_GUI_SESSION_MANAGER_H__
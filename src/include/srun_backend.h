@@ -4,25 +4,115 @@
 #include <srun/common.h>
 #include <srun/srun.h>
 
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
 #include <string_view>
+#include <vector>
 
 #include "common/msg.h"
 #include "csp/receiver.h"
+#include "csp/sample_ring.h"
+#include "csp/select.h"
+#include "csp/single_flight.h"
+#include "csp/timer_service.h"
+#include "info_poller.h"
+#include "session_manager.h"
+#include "watchdog.h"
 
 namespace srun_gui {
 
 class SrunBackend {
  public:
-  auto setUi(std::unique_ptr<Sender> ui) -> void { _ui = std::move(ui); }
+  // Tags of `portalCalls`.
+  enum PortalCall : std::uint32_t {
+    PORTAL_LOGIN,
+    PORTAL_INFO,
+    PORTAL_LOGOUT,
+    PORTAL_CHECK_ONLINE
+  };
+
+  SrunBackend();
+
+  // The dispatchers hold `this`.
+  SrunBackend(const SrunBackend&) = delete;
+
+  SrunBackend(SrunBackend&&) noexcept = delete;
+
+  SrunBackend& operator=(const SrunBackend&) = delete;
+
+  SrunBackend& operator=(SrunBackend&&) noexcept = delete;
+
+  ~SrunBackend() = default;
+
+  // Called once. Account reports reach the ui through the local lane.
+  auto setUi(const SessionManager::SenderFactory& ui,
+             SessionOptions sessions = {}) -> void {
+    _ui = ui();
+    _network_ui = ui();
+    _sessions = std::make_unique<SessionManager>(
+        [this] { return _receiver.getSender(); }, sessions);
+  }
+
+  // Sends a copy of every result for the ui to `observer` too, e.g. a
+  // ControlSocket. Call before run.
+  auto addObserver(const SessionManager::SenderFactory& observer) -> void {
+    _observers.push_back(observer());
+    _network_observers.push_back(observer());
+  }
+
+  // Call before run.
+  auto setPollOptions(const PollOptions& options) -> void {
+    _poller = InfoPoller{options};
+  }
+
+  // Call before run.
+  auto setWatchdogOptions(const WatchdogOptions& options) -> void {
+    _watchdog.setOptions(options);
+  }
 
   auto run() -> void;
 
   auto getSender() const { return _receiver.getSender(); }
 
+  // Control messages (CloseQueueMsg) overtake queued requests.
+  auto getControlSender() const { return _control.getSender(); }
+
+  // Portal calls saved by collapsing duplicate requests, per request type.
+  auto flights() const -> const FlightCounters& { return _flights; }
+
+  // Drops of the logged in session and how fast they were recovered.
+  auto watchdogMetrics() const { return _watchdog.metrics(); }
+
+  // For a performance overlay: how long requests waited in the local and
+  // the network lane's queue, and how many wait right now.
+  auto requestLatency() const -> const LatencyRing& {
+    return *_request_latency;
+  }
+
+  auto networkLatency() const -> const LatencyRing& {
+    return *_network_latency;
+  }
+
+  auto requestQueueDepth() const { return _receiver.size(); }
+
+  auto networkQueueDepth() const { return _network.size(); }
+
+  // Durations of the backend's own portal calls, tagged with PortalCall.
+  auto portalCalls() const -> const LatencyRing& { return _portal_calls; }
+
  private:
+  // Local lane only.
   template <typename Msg>
   auto sendToUi(Msg&& msg) {
+    for (const auto& observer : _observers) {
+      observer->send(msg);
+    }
+
     if (!_ui) {
       return;
     }
@@ -30,25 +120,123 @@ class SrunBackend {
     _ui->send(std::forward<Msg>(msg));
   }
 
+  // Network lane only. Updates of an operation the ui cancelled are not
+  // sent. Those that are carry the token, so the ui queue drops them if it
+  // cancels later.
+  template <typename Msg>
+  auto sendToUi(const CancelToken& cancel, Msg msg) {
+    if (cancel.cancelled()) {
+      return;
+    }
+
+    // Observers did not start the operation, so they cannot cancel it.
+    for (const auto& observer : _network_observers) {
+      observer->send(msg);
+    }
+
+    if (!_network_ui) {
+      return;
+    }
+
+    msg.cancel = cancel;
+    _network_ui->send(std::move(msg));
+  }
+
+  // In one lane, so the network lane keeps the order of the requests.
+  template <typename Msg>
+  auto toNetwork(Msg&& msg) {
+    _to_network->send(std::forward<Msg>(msg), Lane::Normal);
+  }
+
   auto idle() -> void;
 
+  auto networkLane() -> void;
+
+  // Takes the config the local lane staged last, if any.
+  auto applyConfig() -> void;
+
   auto loadConfig(const Config& config) -> void;
 
   auto loadConfigFile(std::string_view config_file) -> void;
 
-  auto login() -> void;
+  auto login(const CancelToken& cancel) -> void;
+
+  using InfoCall = Call<RequestInfo, DrawInfo>;
+
+  // Single flight: one portal call serves `request` or `call` and every
+  // duplicate queued right behind it or arriving while it runs.
+  auto getInfo(const RequestInfo* request, const InfoCall* call) -> void;
+
+  auto logout(const CancelToken& cancel) -> void;
 
-  auto getInfo() -> void;
+  // Starts or retunes polling for `request`; stops once its token fires.
+  auto startPolling(const RequestPollInfo& request) -> void;
 
-  auto logout() -> void;
+  auto pollInfo(const TimerFired& timer) -> void;
 
-  auto makeDrawInfo(const srun::InfoResponse& info) -> DrawInfo;
+  // Keeps the session online from a successful login until logout.
+  auto startWatchdog() -> void;
+
+  auto stopWatchdog() -> void;
+
+  auto watch(const TimerFired& timer) -> void;
+
+  // Network lane only.
+  auto recordPortal(PortalCall call,
+                    std::chrono::steady_clock::time_point started) -> void {
+    _portal_calls.record(call, std::chrono::steady_clock::now() - started);
+  }
+
+  // Reports the new account, or an ErrMsg if it exists.
+  auto addAccount(const std::string& account, const Config& config) -> void;
+
+  // Reports an ErrMsg if `account` is not managed.
+  auto checkAccount(bool known, const std::string& account) -> void;
 
   void (SrunBackend::*_state)(){&SrunBackend::idle};
 
-  Receiver _receiver;
+  // Channel indices follow the creation order of the receivers below.
+  enum Channel : std::size_t { CONTROL_CHANNEL, REQUEST_CHANNEL };
+  static constexpr int CONTROL_PRIORITY = 1;
+
+  // Written by the local and the network lane respectively.
+  std::shared_ptr<LatencyRing> _request_latency{
+      std::make_shared<LatencyRing>()};
+  std::shared_ptr<LatencyRing> _network_latency{
+      std::make_shared<LatencyRing>()};
+  LatencyRing _portal_calls;
+
+  Select _select;
+  Receiver _control{_select.channel(CONTROL_PRIORITY)};
+  Receiver _receiver{_select.channel()};
+  AnyDispatcher _control_dispatcher;
+  AnyDispatcher _requests;
   std::unique_ptr<Sender> _ui;
+  std::vector<std::unique_ptr<Sender>> _observers;
+
+  // Portal calls run on their own lane, so a slow portal never holds up
+  // local requests. `_client` belongs to that lane.
+  Receiver _network;
+  AnyDispatcher _network_requests;
+  std::unique_ptr<Sender> _to_network{_network.getSender()};
+  std::unique_ptr<Sender> _network_ui;
+  std::vector<std::unique_ptr<Sender>> _network_observers;
+  FlightCounters _flights;
   srun::SrunClient _client;
+
+  // Network lane state; timers fire into `_network`.
+  TimerService _timers;
+  InfoPoller _poller;
+  std::optional<TimerId> _poll_timer;
+  CancelToken _poll_cancel;
+  Watchdog _watchdog;
+  std::optional<TimerId> _watchdog_timer;
+
+  // Staged by the local lane, applied before the next portal call.
+  std::mutex _config_mutex;
+  std::optional<Config> _staged_config;
+
+  std::unique_ptr<SessionManager> _sessions;
 };
 
 }  // namespace srun_gui
@@ -1,32 +1,109 @@
 #ifndef __SRUN_GUI_UI_UI_H__
 #define __SRUN_GUI_UI_UI_H__
 
+#include <chrono>
+#include <cstddef>
 #include <functional>
+#include <map>
+#include <memory>
 #include <optional>
 #include <string>
 #include <string_view>
 
 #include "common/msg.h"
+#include "csp/cancel.h"
 #include "csp/receiver.h"
+#include "csp/request.h"
+#include "csp/sample_ring.h"
 
 namespace srun_gui {
 
 class Ui {
  public:
+  Ui();
+
+  // The dispatchers hold `this`.
+  Ui(const Ui&) = delete;
+
+  Ui(Ui&&) noexcept = delete;
+
+  Ui& operator=(const Ui&) = delete;
+
+  Ui& operator=(Ui&&) noexcept = delete;
+
+  ~Ui() = default;
+
   auto loadConfig(std::string_view config_file) -> void;
 
-  auto action() { (this->*_state)(); }
+  auto action() {
+    _stop_drain = false;
+    _calls.poll();
+    (this->*_state)();
+    syncPolling();
+  }
+
+  // Iconified windows poll info less often.
+  auto setHidden(bool hidden) {
+    _hidden = hidden;
+    syncPolling();
+  }
+
+  // Without a window nothing shows info, so it is not polled at all.
+  auto setBackground(bool background) {
+    _background = background;
+    syncPolling();
+  }
+
+  // Where RequestShowWindow goes.
+  auto getWindowSender() const { return _window.getSender(); }
+
+  // The newest RequestShowWindow since the last call, if any.
+  auto windowRequest() -> std::optional<bool>;
 
   auto setSrun(std::unique_ptr<Sender> srun) { _srun = std::move(srun); }
 
   auto getSender() const { return _receiver.getSender(); }
 
+  // Runs on the sender's thread whenever a message arrives, to wake a main
+  // loop that waits for events. Call before handing out senders.
+  // Call replies, which arrive without a message, wake it too.
+  auto setWaker(const std::function<void()>& waker) {
+    _receiver.setWaker(waker);
+    _window.setWaker(waker);
+    _waker = waker;
+  }
+
+  // True while frames must be drawn without input or messages: the waiting
+  // progress bar spins.
+  auto animating() const { return _state == &Ui::drawWait; }
+
+  // How long backend messages waited for the ui, and how many wait now.
+  auto latency() const -> const LatencyRing& { return *_latency; }
+
+  auto queueDepth() const { return _receiver.size(); }
+
+  // True once a CloseQueueMsg was handled; the ui stops acting then.
+  auto closed() const { return _receiver.closed(); }
+
+  // How many backend messages one frame may handle. Whatever is left is
+  // handled in the next frame.
+  auto setDrainBudget(std::size_t max_messages,
+                      std::chrono::steady_clock::duration max_time) {
+    _drain_budget.max_messages = max_messages;
+    _drain_budget.max_time = max_time;
+  }
+
   auto configFile() const { return _config_file; }
 
   auto config() const { return _config; }
 
   auto userInfo() const { return _user_info; }
 
+  // The latest DrawAccount of every SessionManager account.
+  auto accounts() const -> const std::map<std::string, DrawAccount>& {
+    return _accounts;
+  }
+
  private:
   auto drawIdle() -> void;
 
@@ -34,13 +111,43 @@ class Ui {
 
   auto drawInfo() -> void;
 
+  // The handlers each state pumps every frame.
+  auto idleDispatcher() -> AnyDispatcher;
+
+  auto waitDispatcher() -> AnyDispatcher;
+
+  auto infoDispatcher() -> AnyDispatcher;
+
   auto configWidget() -> void;
 
   auto infoWidget() -> void;
 
+  // SessionManager accounts, e.g. added through the control socket.
+  auto accountsWidget() -> void;
+
   enum class PopupType : std::uint8_t { Unknown, Error, Warning, Info };
 
-  constexpr auto popupId(PopupType type) -> const char*;
+  static constexpr auto popupId(PopupType type) -> const char* {
+    switch (type) {
+      case PopupType::Error:
+        return "Error";
+      case PopupType::Warning:
+        return "Warning";
+      case PopupType::Info:
+        return "Info";
+      default:
+        return "Unknown";
+    }
+  }
+
+  // A state's alert popup. The state handles no messages while
+  // `enable_handle` is off.
+  struct Popup {
+    std::string msg{"UNKNOWN ERROR"};
+    const char* id{popupId(PopupType::Unknown)};
+    std::function<void()> callback;
+    bool enable_handle{true};
+  };
 
   template <typename Msg>
   auto sendToSrun(Msg&& msg) {
@@ -51,31 +158,102 @@ class Ui {
     _srun->send(std::forward<Msg>(msg));
   }
 
+  // `on_reply(Rsp&)` runs from `action` once the backend answered.
+  template <typename Rsp, typename Req, typename OnReply>
+  auto callSrun(Req&& request, OnReply&& on_reply)
+      -> std::optional<CorrelationId> {
+    if (!_srun) {
+      return std::nullopt;
+    }
+
+    return _calls.add(_srun->call<Rsp>(std::forward<Req>(request), _waker),
+                      std::forward<OnReply>(on_reply));
+  }
+
   auto validConfig(const Config& config) -> std::optional<std::string>;
 
+  // The info text is only formatted again once the info changed.
+  auto updateUserInfo(const UserInfo& info) {
+    if (info == _user_info) {
+      return;
+    }
+
+    _user_info = info;
+    _user_info_dirty = true;
+  }
+
+  // Every state handles account reports, whatever its own flow is.
+  auto updateAccount(const DrawAccount& msg) {
+    if (msg.removed) {
+      _accounts.erase(msg.account);
+      return;
+    }
+    _accounts[msg.account] = msg;
+  }
+
   auto transitState(void (Ui::*state)()) {
     _last_state = _state;
     _state = state;
+    _stop_drain = true;
   }
 
   auto revertState() {
     _state = _last_state;
     _last_state = nullptr;
+    _stop_drain = true;
+  }
+
+  // Starts the operation the waiting state's Cancel button cancels.
+  auto newOperation() {
+    _operation = CancelSource{};
+    return _operation.token();
   }
 
   auto toWaiting(std::string_view overlap, bool enable_cancel = true,
                  std::function<void()> widget = nullptr) -> void;
 
+  // The backend polls info while the info page shows. Leaving it cancels
+  // the polls, which also drops their results still queued.
+  auto syncPolling() -> void;
+
  private:
   void (Ui::*_state)(){&Ui::drawIdle};
   void (Ui::*_last_state)(){nullptr};
 
+  std::shared_ptr<LatencyRing> _latency{std::make_shared<LatencyRing>()};
   Receiver _receiver;
+  Receiver _window;
+  AnyDispatcher _window_dispatcher;
+  AnyDispatcher _idle_dispatcher;
+  AnyDispatcher _wait_dispatcher;
+  AnyDispatcher _info_dispatcher;
+  Popup _idle_popup;
+  Popup _wait_popup;
+  std::optional<bool> _window_request;
   std::unique_ptr<Sender> _srun;
+  // Requests in flight that answer through a callback, see `callSrun`.
+  PendingCalls _calls;
+  std::function<void()> _waker;
+  std::optional<CorrelationId> _refresh_call;
+  CancelSource _operation;
+  CancelSource _polling;
+  bool _polling_on{false};
+  bool _polling_hidden{false};
+  bool _hidden{false};
+  bool _background{false};
+  // Set when a handler changes state or opens a popup, so the rest of the
+  // frame's messages are left for the new state.
+  bool _stop_drain{false};
+  DrainBudget _drain_budget{.max_messages = 32,
+                            .max_time = std::chrono::milliseconds{4},
+                            .stop = &_stop_drain};
 
   std::string _config_file;
   Config _config;
   UserInfo _user_info;
+  bool _user_info_dirty{true};
+  std::string _user_info_text;
+  std::map<std::string, DrawAccount> _accounts;
 };
 
 }  // namespace srun_gui
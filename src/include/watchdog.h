@@ -0,0 +1,90 @@
+#ifndef __SRUN_GUI_WATCHDOG_H__
+#define __SRUN_GUI_WATCHDOG_H__
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <random>
+
+namespace srun_gui {
+
+struct WatchdogOptions {
+  bool enabled{true};
+  std::chrono::milliseconds check_interval{std::chrono::seconds{30}};
+  // Re-login backoff: base * 2^(failures - 1), capped at retry_max.
+  std::chrono::milliseconds retry_base{std::chrono::seconds{2}};
+  std::chrono::milliseconds retry_max{std::chrono::minutes{5}};
+  double jitter{0.2};
+  // Failed re-logins in a row that open the breaker. While open, one
+  // attempt is made per cooldown.
+  std::size_t breaker_threshold{5};
+  std::chrono::milliseconds breaker_cooldown{std::chrono::minutes{10}};
+};
+
+struct WatchdogMetrics {
+  using Duration = std::chrono::steady_clock::duration;
+
+  std::uint64_t drops{0};
+  std::uint64_t recoveries{0};
+  std::uint64_t failed_logins{0};
+  std::uint64_t breaker_trips{0};
+  // Time to detect is measured from the last check that saw us online, so
+  // it is an upper bound.
+  Duration last_time_to_detect{};
+  Duration last_time_to_recover{};
+  Duration total_time_to_recover{};
+};
+
+// Keeps a logged in session online. The owner runs `action` after every
+// returned delay and reports the outcome; the watchdog only decides.
+class Watchdog {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  enum class Action : std::uint8_t { None, CheckOnline, Login };
+
+  explicit Watchdog(WatchdogOptions options = {});
+
+  // Before the first start.
+  auto setOptions(WatchdogOptions options) -> void;
+
+  // After a login, returns the delay until the first check.
+  auto start(Clock::time_point now) -> Clock::duration;
+
+  auto stop() -> void;
+
+  auto enabled() const { return _options.enabled; }
+
+  auto action() const { return _action; }
+
+  auto breakerOpen() const { return _failures >= _options.breaker_threshold; }
+
+  // Both return the delay until the next action.
+  auto onCheck(bool online, Clock::time_point now) -> Clock::duration;
+
+  auto onLogin(bool ok, Clock::time_point now) -> Clock::duration;
+
+  // Safe from any thread.
+  auto metrics() const -> WatchdogMetrics;
+
+ private:
+  auto backoff() -> Clock::duration;
+
+  auto jittered(Clock::duration delay) -> Clock::duration;
+
+  WatchdogOptions _options;
+  Action _action{Action::None};
+  std::size_t _failures{0};
+  Clock::time_point _last_online;
+  Clock::time_point _detected_at;
+
+  mutable std::mutex _metrics_mutex;
+  WatchdogMetrics _metrics;
+
+  std::mt19937 _rng{std::random_device{}()};
+};
+
+}  // namespace srun_gui
+
+#endif  // __SRUN_GUI_WATCHDOG_H__
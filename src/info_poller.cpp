@@ -0,0 +1,50 @@
+#include "info_poller.h"
+
+#include <algorithm>
+
+namespace srun_gui {
+
+InfoPoller::InfoPoller(PollOptions options)
+    : _options{options}, _interval{options.interval} {}
+
+auto InfoPoller::onResult(const DrawInfo& info, Clock::time_point now)
+    -> bool {
+  auto changed = !_has_last || info.err_msg != _last_err ||
+                 info.user_info != _last_info;
+  if (!changed) {
+    _interval = std::min<Clock::duration>(_interval * 2,
+                                          _options.max_interval);
+  } else if (_has_last && !info.err_msg && !_last_err) {
+    auto before = _last_info.in_bytes + _last_info.out_bytes;
+    auto after = info.user_info.in_bytes + info.user_info.out_bytes;
+    auto seconds = std::chrono::duration<double>(now - _last_at).count();
+    // Counters restart with a new session.
+    auto rate = after < before || seconds <= 0
+                    ? 0.0
+                    : static_cast<double>(after - before) / seconds;
+    _interval = rate < _options.fast_rate
+                    ? Clock::duration{_options.interval}
+                    : std::max<Clock::duration>(_interval / 2,
+                                                _options.min_interval);
+  } else {
+    _interval = _options.interval;
+  }
+
+  _has_last = true;
+  _last_err = info.err_msg;
+  _last_info = info.user_info;
+  _last_at = now;
+  return changed;
+}
+
+auto InfoPoller::nextDelay() -> Clock::duration {
+  auto interval = _hidden ? std::max<Clock::duration>(
+                                _interval, _options.hidden_interval)
+                          : _interval;
+  std::uniform_real_distribution<double> scale{1.0 - _options.jitter,
+                                               1.0 + _options.jitter};
+  return std::chrono::duration_cast<Clock::duration>(interval *
+                                                     scale(_rng));
+}
+
+}  // namespace srun_gui
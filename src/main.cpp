@@ -1,13 +1,28 @@
 
 
+#include <algorithm>
+#include <chrono>
 #include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
 #include <iostream>
+#include <optional>
 #include <thread>
 
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+#include "control_socket.h"
 #include "csp/dispatcher.h"
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
+#include "perf_overlay.h"
 #include "srun_backend.h"
 #include "ui.h"
 
@@ -32,13 +47,147 @@ static void glfwErrorCallback(int error, const char *description) {
   fprintf(stderr, "GLFW Error %d: %s\n", error, description);
 }
 
+static auto residentBytes() -> std::optional<std::size_t> {
+#if defined(__linux__)
+  std::ifstream statm{"/proc/self/statm"};
+  std::size_t pages = 0;
+  std::size_t resident = 0;
+  if (statm >> pages >> resident) {
+    return resident * static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+  }
+#endif
+  return std::nullopt;
+}
+
+// Set SRUN_GUI_RENDER_STATS to print, whenever the window is closed or
+// opened and on exit, how often the main loop woke up, the frames it drew,
+// the CPU time used and the resident memory. SRUN_GUI_CONTINUOUS_RENDER
+// draws every vsync, for comparison.
+class RenderStats {
+ public:
+  auto wakeup() { ++_wakeups; }
+
+  auto frame() { ++_frames; }
+
+  // Prints what happened in `mode` and starts counting the next one.
+  void report(const char *mode) {
+    auto now = std::chrono::steady_clock::now();
+    auto cpu = std::clock();
+    if (_enabled) {
+      auto seconds = std::chrono::duration<double>(now - _start).count();
+      auto cpu_seconds =
+          static_cast<double>(cpu - _cpu_start) / CLOCKS_PER_SEC;
+      fprintf(stderr,
+              "%s: %.1f s, %zu wakeups (%.1f/s), %zu frames, CPU %.2f s "
+              "(%.1f%%)",
+              mode, seconds, _wakeups, static_cast<double>(_wakeups) / seconds,
+              _frames, cpu_seconds, 100.0 * cpu_seconds / seconds);
+      if (auto rss = residentBytes(); rss.has_value()) {
+        fprintf(stderr, ", RSS %.1f MiB",
+                static_cast<double>(rss.value()) / (1024.0 * 1024.0));
+      }
+      fprintf(stderr, "\n");
+    }
+
+    _wakeups = 0;
+    _frames = 0;
+    _start = now;
+    _cpu_start = cpu;
+  }
+
+ private:
+  bool _enabled{std::getenv("SRUN_GUI_RENDER_STATS") != nullptr};
+  std::size_t _wakeups{0};
+  std::size_t _frames{0};
+  std::chrono::steady_clock::time_point _start{
+      std::chrono::steady_clock::now()};
+  std::clock_t _cpu_start{std::clock()};
+};
+
+// Creates the window, its GL context and the ImGui context drawn into it.
+// The font atlas and GL objects are built lazily by the first frame.
+static auto openWindow(const char *glsl_version) -> GLFWwindow * {
+  GLFWwindow *window =
+      glfwCreateWindow(1280, 720, "Srun Gui", nullptr, nullptr);
+  if (window == nullptr) {
+    return nullptr;
+  }
+  glfwMakeContextCurrent(window);
+  glfwSwapInterval(1);  // Enable vsync
+
+  // Setup Dear ImGui context
+  IMGUI_CHECKVERSION();
+  ImGui::CreateContext();
+  ImGuiIO &io = ImGui::GetIO();
+  io.ConfigFlags |=
+      ImGuiConfigFlags_NavEnableKeyboard;  // Enable Keyboard Controls
+  io.ConfigFlags |=
+      ImGuiConfigFlags_NavEnableGamepad;  // Enable Gamepad Controls
+#ifdef __EMSCRIPTEN__
+  // For an Emscripten build we are disabling file-system access, so let's not
+  // attempt to do a fopen() of the imgui.ini file. You may manually call
+  // LoadIniSettingsFromMemory() to load settings from your own storage.
+  io.IniFilename = nullptr;
+#endif
+
+  // Setup Dear ImGui style
+  //   ImGui::StyleColorsDark();
+  ImGui::StyleColorsLight();
+  // ImGui::StyleColorsClassic();
+
+  // Setup Platform/Renderer backends
+  ImGui_ImplGlfw_InitForOpenGL(window, true);
+#ifdef __EMSCRIPTEN__
+  ImGui_ImplGlfw_InstallEmscriptenCallbacks(window, "#canvas");
+#endif
+  ImGui_ImplOpenGL3_Init(glsl_version);
+  return window;
+}
+
+// Frees the GL objects, the font atlas, ImGui's buffers and the window. The
+// Ui keeps its own state, so openWindow brings everything back.
+static void closeWindow(GLFWwindow *window) {
+  ImGui_ImplOpenGL3_Shutdown();
+  ImGui_ImplGlfw_Shutdown();
+  ImGui::DestroyContext();
+
+  glfwDestroyWindow(window);
+#if defined(__GLIBC__)
+  // Hands the freed heap back to the system instead of keeping it resident.
+  malloc_trim(0);
+#endif
+}
+
 // Main code
 int main(int argc, char **argv) {
+  srun_gui::SrunBackend srun_backend;
+
   glfwSetErrorCallback(glfwErrorCallback);
   if (glfwInit() == 0) {
     return 1;
   }
 
+  srun_gui::Ui ui;
+  // A message for the ui ends the main loop's wait for events.
+  ui.setWaker([] { glfwPostEmptyEvent(); });
+
+  // Scripts drive this instance through the socket instead of starting a
+  // second one.
+  srun_gui::ControlSocket control;
+  switch (control.start(srun_backend.getSender(), ui.getWindowSender())) {
+    case srun_gui::ControlSocket::Status::AlreadyRunning:
+      std::cerr << "Srun Gui is already running, see " << control.path()
+                << "\n";
+      glfwTerminate();
+      return 1;
+    case srun_gui::ControlSocket::Status::Failed:
+      std::cerr << "No control socket at " << control.path() << "\n";
+      break;
+    case srun_gui::ControlSocket::Status::Started:
+      srun_backend.addObserver([&control] { return control.getSender(); });
+      break;
+  }
+
   // Decide GL+GLSL versions
 #if defined(IMGUI_IMPL_OPENGL_ES2)
   // GL ES 2.0 + GLSL 100
@@ -63,75 +212,116 @@ int main(int argc, char **argv) {
 #endif
 
   // Create window with graphics context
-  GLFWwindow *window =
-      glfwCreateWindow(1280, 720, "Srun Gui", nullptr, nullptr);
+  GLFWwindow *window = openWindow(glsl_version);
   if (window == nullptr) {
     return 1;
   }
-  glfwMakeContextCurrent(window);
-  glfwSwapInterval(1);  // Enable vsync
-
-  // Setup Dear ImGui context
-  IMGUI_CHECKVERSION();
-  ImGui::CreateContext();
-  ImGuiIO &io = ImGui::GetIO();
-  (void)io;
-  io.ConfigFlags |=
-      ImGuiConfigFlags_NavEnableKeyboard;  // Enable Keyboard Controls
-  io.ConfigFlags |=
-      ImGuiConfigFlags_NavEnableGamepad;  // Enable Gamepad Controls
-
-  // Setup Dear ImGui style
-  //   ImGui::StyleColorsDark();
-  ImGui::StyleColorsLight();
-  // ImGui::StyleColorsClassic();
-
-  // Setup Platform/Renderer backends
-  ImGui_ImplGlfw_InitForOpenGL(window, true);
-#ifdef __EMSCRIPTEN__
-  ImGui_ImplGlfw_InstallEmscriptenCallbacks(window, "#canvas");
-#endif
-  ImGui_ImplOpenGL3_Init(glsl_version);
 
   std::string config_file = "config.json";
   if (2 <= argc) {
     config_file = argv[1];
   }
 
-  srun_gui::Ui ui;
-  srun_gui::SrunBackend srun_backend;
-
   auto t = std::thread{[&] {
-    srun_backend.setUi(ui.getSender());
+    srun_backend.setUi([&ui] { return ui.getSender(); });
     srun_backend.run();
   }
 
   };
 
-  t.detach();
+  auto stop_backend = [&] {
+    srun_backend.getControlSender()->send(srun_gui::CloseQueueMsg{});
+    t.join();
+  };
+
   ui.setSrun(srun_backend.getSender());
   ui.loadConfig(config_file);
 
+  srun_gui::PerfOverlay perf;
+  perf.addQueue("Ui", [&ui] { return ui.queueDepth(); }, ui.latency());
+  perf.addQueue(
+      "Backend", [&] { return srun_backend.requestQueueDepth(); },
+      srun_backend.requestLatency());
+  perf.addQueue(
+      "Network", [&] { return srun_backend.networkQueueDepth(); },
+      srun_backend.networkLatency());
+  // In SrunBackend::PortalCall order.
+  perf.setPortalCalls(srun_backend.portalCalls(),
+                      {"Login", "Info", "Logout", "Check online"});
+
   ImVec4 clear_color = ImVec4(0.45F, 0.55F, 0.60F, 1.00F);
 
+  // Frames are only drawn after input, after a message for the ui and while
+  // the ui animates. ImGui needs a few frames to settle after input, and a
+  // redraw now and then keeps its own timers, e.g. tooltips, going.
+  constexpr int SETTLE_FRAMES = 3;
+  constexpr auto IDLE_TIMEOUT = std::chrono::seconds{1};
+  const bool continuous = std::getenv("SRUN_GUI_CONTINUOUS_RENDER") != nullptr;
+  int settle_frames = SETTLE_FRAMES;
+  RenderStats stats;
+
   // Main loop
 #ifdef __EMSCRIPTEN__
-  // For an Emscripten build we are disabling file-system access, so let's not
-  // attempt to do a fopen() of the imgui.ini file. You may manually call
-  // LoadIniSettingsFromMemory() to load settings from your own storage.
-  io.IniFilename = nullptr;
   EMSCRIPTEN_MAINLOOP_BEGIN
 #else
-  while (glfwWindowShouldClose(window) == 0)
+  while (window == nullptr || glfwWindowShouldClose(window) == 0)
 #endif
   {
+#ifdef __EMSCRIPTEN__
     glfwPollEvents();
-    if (glfwGetWindowAttrib(window, GLFW_ICONIFIED) != 0) {
-      ImGui_ImplGlfw_Sleep(10);
+#else
+    if (window == nullptr) {
+      // Hidden: the backend keeps the session online, and only a message
+      // for the ui wakes this thread. Those wait in the queue until shown.
+      glfwWaitEvents();
+      stats.wakeup();
+      if (ui.windowRequest().value_or(false)) {
+        stats.report("Hidden");
+        window = openWindow(glsl_version);
+        if (window == nullptr) {
+          stop_backend();
+          glfwTerminate();
+          return 1;
+        }
+        ui.setBackground(false);
+        settle_frames = SETTLE_FRAMES;
+      }
       continue;
     }
 
+    // Iconified windows draw nothing, so they only wait for events.
+    if (glfwGetWindowAttrib(window, GLFW_ICONIFIED) == 0 &&
+        (continuous || 0 < settle_frames || ui.animating() ||
+         ImGui::GetIO().WantTextInput)) {
+      glfwPollEvents();
+    } else {
+      glfwWaitEventsTimeout(
+          std::chrono::duration<double>(IDLE_TIMEOUT).count());
+      settle_frames = SETTLE_FRAMES;
+    }
+    settle_frames = std::max(settle_frames - 1, 0);
+    stats.wakeup();
+
+    if (auto show = ui.windowRequest(); show.has_value()) {
+      if (!show.value()) {
+        stats.report("Shown");
+        ui.setBackground(true);
+        closeWindow(window);
+        window = nullptr;
+        continue;
+      }
+
+      glfwRestoreWindow(window);
+      glfwFocusWindow(window);
+    }
+#endif
+    auto iconified = glfwGetWindowAttrib(window, GLFW_ICONIFIED) != 0;
+    ui.setHidden(iconified);
+    if (iconified) {
+      continue;
+    }
     // Start the Dear ImGui frame
+    auto frame_start = std::chrono::steady_clock::now();
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
     ImGui::NewFrame();
@@ -141,14 +331,15 @@ int main(int argc, char **argv) {
     ImGui::SetNextWindowSize(screen_size, ImGuiCond_Always);
     ImGui::SetNextWindowPos(ImVec2(0, 0), ImGuiCond_Always);
 
-    {
-      try {
-        ui.action();
-      } catch (const srun_gui::DispatcherExceptionGetCloseQueueMsg &e) {
-        std::cerr << e.what() << "\n";
-        return 1;
-      }
+    auto action_start = std::chrono::steady_clock::now();
+    ui.action();
+    auto action_time = std::chrono::steady_clock::now() - action_start;
+    if (ui.closed()) {
+      std::cerr << "Ui received CloseQueueMsg\n";
+      stop_backend();
+      return 1;
     }
+    perf.draw();
 
     // Rendering
     ImGui::Render();
@@ -160,19 +351,21 @@ int main(int argc, char **argv) {
                  clear_color.z * clear_color.w, clear_color.w);
     glClear(GL_COLOR_BUFFER_BIT);
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    perf.recordFrame(std::chrono::steady_clock::now() - frame_start,
+                     action_time);
 
     glfwSwapBuffers(window);
+    stats.frame();
   }
 #ifdef __EMSCRIPTEN__
   EMSCRIPTEN_MAINLOOP_END;
 #endif
 
-  // Cleanup
-  ImGui_ImplOpenGL3_Shutdown();
-  ImGui_ImplGlfw_Shutdown();
-  ImGui::DestroyContext();
+  stats.report("Shown");
 
-  glfwDestroyWindow(window);
+  // Cleanup
+  stop_backend();
+  closeWindow(window);
   glfwTerminate();
 
   return 0;
@@ -0,0 +1,234 @@
+#include "perf_overlay.h"
+
+#include <algorithm>
+#include <span>
+
+#include "common/msg.h"
+#include "csp/dispatcher.h"
+#include "csp/request.h"
+#include "csp/timer_service.h"
+#include "imgui.h"
+
+namespace srun_gui {
+
+namespace {
+
+using Sample = LatencyRing::Sample;
+
+// Percentiles of samples sorted by their value, in milliseconds.
+struct Summary {
+  std::size_t _count{};
+  float _p50{};
+  float _p95{};
+  float _p99{};
+  float _max{};
+};
+
+auto summarize(std::span<const Sample> sorted) -> Summary {
+  if (sorted.empty()) {
+    return {};
+  }
+
+  auto at = [&sorted](std::size_t percent) {
+    return static_cast<float>(sorted[(sorted.size() - 1) * percent / 100]
+                                  ._micros) /
+           1000.0F;
+  };
+  return Summary{._count = sorted.size(),
+                 ._p50 = at(50),
+                 ._p95 = at(95),
+                 ._p99 = at(99),
+                 ._max = at(100)};
+}
+
+auto byTagThenValue(const Sample& a, const Sample& b) {
+  return a._tag != b._tag ? a._tag < b._tag : a._micros < b._micros;
+}
+
+// Calls `f(tag, summary)` for each tag of samples sorted by byTagThenValue.
+template <typename F>
+auto forEachTag(std::span<const Sample> sorted, F&& f) {
+  while (!sorted.empty()) {
+    auto tag = sorted.front()._tag;
+    auto end = std::ranges::find_if(
+        sorted, [tag](const Sample& sample) { return sample._tag != tag; });
+    auto count = static_cast<std::size_t>(end - sorted.begin());
+    f(tag, summarize(sorted.first(count)));
+    sorted = sorted.subspan(count);
+  }
+}
+
+template <typename Msg>
+auto named(const char* name) {
+  return std::pair{messageTypeId<Msg>(), std::string{name}};
+}
+
+constexpr auto TABLE_FLAGS = ImGuiTableFlags_Borders |
+                             ImGuiTableFlags_RowBg |
+                             ImGuiTableFlags_SizingFixedFit;
+
+}  // namespace
+
+PerfOverlay::PerfOverlay()
+    : _message_names{named<CloseQueueMsg>("CloseQueueMsg"),
+                     named<ErrMsg>("ErrMsg"),
+                     named<RequestLoadConfigFile>("RequestLoadConfigFile"),
+                     named<RequestLoadConfig>("RequestLoadConfig"),
+                     named<RequestLogin>("RequestLogin"),
+                     named<RequestInfo>("RequestInfo"),
+                     named<RequestLogout>("RequestLogout"),
+                     named<RequestPollInfo>("RequestPollInfo"),
+                     named<RequestAddAccount>("RequestAddAccount"),
+                     named<RequestRemoveAccount>("RequestRemoveAccount"),
+                     named<RequestAccountLogin>("RequestAccountLogin"),
+                     named<RequestAccountInfo>("RequestAccountInfo"),
+                     named<RequestAccountLogout>("RequestAccountLogout"),
+                     named<Call<RequestInfo, DrawInfo>>("InfoCall"),
+                     named<TimerFired>("TimerFired"),
+                     named<DrawConfig>("DrawConfig"),
+                     named<DrawLogin>("DrawLogin"),
+                     named<DrawInfo>("DrawInfo"),
+                     named<DrawLogout>("DrawLogout"),
+                     named<DrawAccount>("DrawAccount")} {
+  _samples.reserve(LatencyRing::CAPACITY);
+}
+
+auto PerfOverlay::addQueue(std::string name, std::function<std::size_t()> depth,
+                           const LatencyRing& latency) -> void {
+  _queues.push_back(Queue{._name = std::move(name),
+                          ._depth = std::move(depth),
+                          ._latency = &latency});
+}
+
+auto PerfOverlay::setPortalCalls(const LatencyRing& calls,
+                                 std::vector<std::string> names) -> void {
+  _portal_calls = &calls;
+  _portal_names = std::move(names);
+}
+
+auto PerfOverlay::draw() -> void {
+  if (ImGui::IsKeyPressed(ImGuiKey_F12, false)) {
+    _visible = !_visible;
+  }
+
+  if (!_visible) {
+    return;
+  }
+
+  ImGui::SetNextWindowPos(ImVec2(10, 10), ImGuiCond_FirstUseEver);
+  ImGui::SetNextWindowBgAlpha(0.9F);
+  if (!ImGui::Begin("Performance (F12)", &_visible,
+                    ImGuiWindowFlags_AlwaysAutoResize)) {
+    ImGui::End();
+    return;
+  }
+
+  _frame_times.snapshot(_samples);
+  std::ranges::sort(_samples, byTagThenValue);
+  auto frame = summarize(_samples);
+  ImGui::Text("Frame      p50 %6.2f  p95 %6.2f  p99 %6.2f  max %6.2f ms",
+              frame._p50, frame._p95, frame._p99, frame._max);
+
+  _action_times.snapshot(_samples);
+  std::ranges::sort(_samples, byTagThenValue);
+  auto action = summarize(_samples);
+  ImGui::Text("Ui::action p50 %6.2f  p95 %6.2f  p99 %6.2f  max %6.2f ms",
+              action._p50, action._p95, action._p99, action._max);
+  ImGui::Text("Last %zu frames", frame._count);
+
+  ImGui::SeparatorText("Queues");
+  for (const auto& queue : _queues) {
+    drawQueue(queue);
+  }
+
+  if (_portal_calls != nullptr) {
+    ImGui::SeparatorText("Portal calls");
+    drawPortalCalls();
+  }
+
+  ImGui::End();
+}
+
+auto PerfOverlay::drawQueue(const Queue& queue) -> void {
+  ImGui::Text("%s: %zu queued", queue._name.c_str(), queue._depth());
+
+  queue._latency->snapshot(_samples);
+  if (_samples.empty()) {
+    return;
+  }
+
+  std::ranges::sort(_samples, byTagThenValue);
+  ImGui::PushID(queue._name.c_str());
+  if (ImGui::BeginTable("latency", 5, TABLE_FLAGS)) {
+    ImGui::TableSetupColumn("Message");
+    ImGui::TableSetupColumn("Count");
+    ImGui::TableSetupColumn("p50 ms");
+    ImGui::TableSetupColumn("p95 ms");
+    ImGui::TableSetupColumn("max ms");
+    ImGui::TableHeadersRow();
+    forEachTag(_samples, [this](std::uint32_t tag, const Summary& summary) {
+      ImGui::TableNextRow();
+      ImGui::TableNextColumn();
+      ImGui::TextUnformatted(messageName(tag));
+      ImGui::TableNextColumn();
+      ImGui::Text("%zu", summary._count);
+      ImGui::TableNextColumn();
+      ImGui::Text("%.3f", summary._p50);
+      ImGui::TableNextColumn();
+      ImGui::Text("%.3f", summary._p95);
+      ImGui::TableNextColumn();
+      ImGui::Text("%.3f", summary._max);
+    });
+    ImGui::EndTable();
+  }
+  ImGui::PopID();
+}
+
+auto PerfOverlay::drawPortalCalls() -> void {
+  _portal_calls->snapshot(_samples);
+  if (_samples.empty()) {
+    ImGui::TextUnformatted("None yet");
+    return;
+  }
+
+  // Taken before sorting loses the order.
+  auto last = _samples.back();
+  ImGui::Text("Last: %s, %.1f ms",
+              last._tag < _portal_names.size()
+                  ? _portal_names[last._tag].c_str()
+                  : "?",
+              static_cast<float>(last._micros) / 1000.0F);
+
+  std::ranges::sort(_samples, byTagThenValue);
+  if (ImGui::BeginTable("portal", 5, TABLE_FLAGS)) {
+    ImGui::TableSetupColumn("Call");
+    ImGui::TableSetupColumn("Count");
+    ImGui::TableSetupColumn("p50 ms");
+    ImGui::TableSetupColumn("p95 ms");
+    ImGui::TableSetupColumn("max ms");
+    ImGui::TableHeadersRow();
+    forEachTag(_samples, [this](std::uint32_t tag, const Summary& summary) {
+      ImGui::TableNextRow();
+      ImGui::TableNextColumn();
+      ImGui::TextUnformatted(tag < _portal_names.size()
+                                 ? _portal_names[tag].c_str()
+                                 : "?");
+      ImGui::TableNextColumn();
+      ImGui::Text("%zu", summary._count);
+      ImGui::TableNextColumn();
+      ImGui::Text("%.1f", summary._p50);
+      ImGui::TableNextColumn();
+      ImGui::Text("%.1f", summary._p95);
+      ImGui::TableNextColumn();
+      ImGui::Text("%.1f", summary._max);
+    });
+    ImGui::EndTable();
+  }
+}
+
+auto PerfOverlay::messageName(std::uint32_t type_id) const -> const char* {
+  auto it = _message_names.find(type_id);
+  return it != _message_names.end() ? it->second.c_str() : "(other)";
+}
+
+}  // namespace srun_gui
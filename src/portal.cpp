@@ -0,0 +1,123 @@
+#include "portal.h"
+
+#include <srun/exception.h>
+
+#include <vector>
+
+namespace srun_gui {
+
+namespace {
+
+auto makeDrawInfo(const srun::InfoResponse& info) -> DrawInfo {
+  std::vector<OnlineDeviceInfo> online_device_info;
+  for (const auto& device : info.onlineDevices()) {
+    online_device_info.push_back(
+        OnlineDeviceInfo{.class_name = device.className(),
+                         .ipv4 = device.ipv4(),
+                         .ipv6 = device.ipv6(),
+                         .os_name = device.osName(),
+                         .rad_online_id = device.radOnlineId()});
+  }
+
+  return DrawInfo{
+      .err_msg = {},
+      .finished = true,
+      .user_info = {.username = info.username(),
+                    .online_ip = info.onlineIp(),
+                    .mac = info.userMac(),
+                    .wallet_balance = static_cast<double>(info.walletBalance()),
+                    .remain_seconds = info.remainSeconds(),
+                    .sum_seconds = info.sumSeconds(),
+                    .in_bytes = info.bytesIn(),
+                    .out_bytes = info.bytesOut(),
+                    .remain_bytes = info.remainBytes(),
+                    .sum_bytes = info.sumBytes(),
+                    .online_device_info = online_device_info}};
+}
+
+}  // namespace
+
+auto configureClient(srun::SrunClient& client, const Config& config) -> void {
+  if (!config.auto_ip) {
+    client.setIp(config.ip);
+  }
+
+  if (!config.auto_ac_id) {
+    client.setAcId(config.ac_id);
+  }
+
+  client.setSsl(config.protocol == "https");
+  client.setHost(config.host);
+  client.setPort(config.port);
+  client.setUsername(config.username);
+  client.setPassword(config.password);
+}
+
+auto readConfigFile(std::string_view config_file) -> Config {
+  srun::SrunClient client;
+  client.init(config_file);
+  return Config{.protocol = client.ssl() ? "https" : "http",
+                .host = client.host(),
+                .port = client.port(),
+                .username = client.username(),
+                .password = client.password(),
+                .auto_ip = client.autoIp(),
+                .ip = client.ip(),
+                .auto_ac_id = client.autoAcId(),
+                .ac_id = client.acId()};
+}
+
+auto portalKey(const Config& config) -> std::string {
+  return config.protocol + "://" + config.host + ":" + config.port;
+}
+
+auto loginClient(srun::SrunClient& client, const CancelToken& cancel,
+                 const std::function<void(DrawLogin)>& report) -> void {
+  try {
+    // is online
+    if (client.checkOnline()) {
+      report(DrawLogin{.finished = true, .username = client.username()});
+      return;
+    }
+
+    // Each step is a portal round trip; stop before the next one if the
+    // user cancelled meanwhile.
+    if (cancel.cancelled()) {
+      return;
+    }
+
+    report(DrawLogin{
+        .err_msg = {}, .finished = false, .username = client.username()});
+
+    client.login();
+
+    report(DrawLogin{
+        .err_msg = {},
+        .finished = true,
+        .username = client.username(),
+    });
+  } catch (const srun::SrunException& e) {
+    report(DrawLogin{.err_msg = e.what(),
+                     .finished = false,
+                     .username = client.username()});
+  }
+}
+
+auto fetchInfo(srun::SrunClient& client) -> DrawInfo {
+  try {
+    return makeDrawInfo(client.getInfo());
+  } catch (const srun::SrunException& e) {
+    return DrawInfo{.err_msg = e.what(), .finished = false, .user_info = {}};
+  }
+}
+
+auto logoutClient(srun::SrunClient& client) -> DrawLogout {
+  try {
+    client.logout();
+    return DrawLogout{.err_msg = {}, .finished = true};
+  } catch (const srun::SrunException& e) {
+    return DrawLogout{.err_msg = e.what(), .finished = false};
+  }
+}
+
+}  // namespace srun_gui
@@ -0,0 +1,303 @@
+#include "session_manager.h"
+
+#include <srun/exception.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <optional>
+
+#include "csp/dispatcher.h"
+#include "portal.h"
+
+namespace srun_gui {
+
+SessionManager::SessionManager(const SenderFactory& make_sender,
+                               SessionOptions options)
+    : _options{options}, _pool{options.threads} {
+  _options.per_portal_limit =
+      std::max<std::size_t>(_options.per_portal_limit, 1);
+  for (std::size_t i = 0; i < _pool.size(); ++i) {
+    _reports.push_back(make_sender());
+  }
+  _watcher = std::thread{[this] { watchLoop(); }};
+}
+
+SessionManager::~SessionManager() {
+  _watch.close();
+  _watcher.join();
+}
+
+auto SessionManager::add(const std::string& account, const Config& config)
+    -> bool {
+  auto session = std::make_shared<Session>();
+  session->_account = account;
+  session->_portal = portalKey(config);
+  configureClient(session->_client, config);
+  session->_watchdog.setOptions(_options.watchdog);
+
+  std::scoped_lock lock{_m};
+  return _sessions.emplace(account, std::move(session)).second;
+}
+
+auto SessionManager::remove(const std::string& account) -> bool {
+  std::scoped_lock lock{_m};
+  auto it = _sessions.find(account);
+  if (it == _sessions.end()) {
+    return false;
+  }
+
+  // A session in its portal's line is skipped once its turn comes.
+  it->second->_removed = true;
+  it->second->_ops.clear();
+  cancelWatch(*it->second);
+  _sessions.erase(it);
+  return true;
+}
+
+auto SessionManager::login(const std::string& account, CancelToken cancel)
+    -> bool {
+  return enqueue(account, Op{OpKind::Login, std::move(cancel)});
+}
+
+auto SessionManager::getInfo(const std::string& account, CancelToken cancel)
+    -> bool {
+  return enqueue(account, Op{OpKind::Info, std::move(cancel)});
+}
+
+auto SessionManager::logout(const std::string& account, CancelToken cancel)
+    -> bool {
+  return enqueue(account, Op{OpKind::Logout, std::move(cancel)});
+}
+
+auto SessionManager::accounts() const -> std::vector<std::string> {
+  std::scoped_lock lock{_m};
+  std::vector<std::string> accounts;
+  accounts.reserve(_sessions.size());
+  for (const auto& [account, session] : _sessions) {
+    accounts.push_back(account);
+  }
+  std::ranges::sort(accounts);
+  return accounts;
+}
+
+auto SessionManager::enqueue(const std::string& account, Op op) -> bool {
+  std::scoped_lock lock{_m};
+  auto it = _sessions.find(account);
+  if (it == _sessions.end()) {
+    return false;
+  }
+
+  push(it->second, std::move(op));
+  return true;
+}
+
+auto SessionManager::push(const std::shared_ptr<Session>& session, Op op)
+    -> void {
+  session->_ops.push_back(std::move(op));
+  schedule(session);
+}
+
+auto SessionManager::schedule(const std::shared_ptr<Session>& session)
+    -> void {
+  if (session->_running || session->_waiting) {
+    return;
+  }
+
+  auto& portal = _portals[session->_portal];
+  session->_waiting = true;
+  portal._waiting.push_back(session);
+  startWaiting(portal);
+}
+
+auto SessionManager::startWaiting(Portal& portal) -> void {
+  while (portal._active < _options.per_portal_limit &&
+         !portal._waiting.empty()) {
+    auto session = std::move(portal._waiting.front());
+    portal._waiting.pop_front();
+    session->_waiting = false;
+    if (session->_removed || session->_ops.empty()) {
+      continue;
+    }
+
+    session->_running = true;
+    ++portal._active;
+    _pool.submit(
+        [this, session](std::size_t worker) { runOne(session, worker); });
+  }
+}
+
+auto SessionManager::runOne(const std::shared_ptr<Session>& session,
+                            std::size_t worker) -> void {
+  std::optional<Op> op;
+  {
+    std::scoped_lock lock{_m};
+    // Empty if the account was removed since the task was submitted.
+    if (!session->_ops.empty()) {
+      op = std::move(session->_ops.front());
+      session->_ops.pop_front();
+    }
+  }
+
+  // The client is only touched by the task holding `_running`.
+  if (op && !op->_cancel.cancelled()) {
+    execute(session, *op, *_reports[worker]);
+  }
+
+  std::scoped_lock lock{_m};
+  session->_running = false;
+  auto& portal = _portals[session->_portal];
+  --portal._active;
+  // Back in line behind the sessions that waited meanwhile.
+  if (!session->_removed && !session->_ops.empty()) {
+    session->_waiting = true;
+    portal._waiting.push_back(session);
+  }
+  startWaiting(portal);
+}
+
+auto SessionManager::execute(const std::shared_ptr<Session>& session,
+                             const Op& op, Sender& report) -> void {
+  auto send = [&](auto update) {
+    if (op._cancel.cancelled()) {
+      return;
+    }
+
+    report.send(DrawAccount{.account = session->_account,
+                            .update = std::move(update),
+                            .cancel = op._cancel});
+  };
+
+  switch (op._kind) {
+    case OpKind::Login: {
+      auto online = false;
+      loginClient(session->_client, op._cancel, [&](DrawLogin msg) {
+        online = msg.finished && !msg.err_msg;
+        send(std::move(msg));
+      });
+      if (online && session->_watchdog.enabled()) {
+        scheduleWatch(session,
+                      session->_watchdog.start(Watchdog::Clock::now()));
+      }
+      break;
+    }
+    case OpKind::Info:
+      send(fetchInfo(session->_client));
+      break;
+    case OpKind::Logout: {
+      auto msg = logoutClient(session->_client);
+      if (msg.finished) {
+        stopWatch(*session);
+      }
+      send(std::move(msg));
+      break;
+    }
+    case OpKind::Watch:
+      watch(session, report);
+      break;
+  }
+}
+
+auto SessionManager::watch(const std::shared_ptr<Session>& session,
+                           Sender& report) -> void {
+  auto& watchdog = session->_watchdog;
+  const auto& account = session->_account;
+  Watchdog::Clock::duration delay{};
+  switch (watchdog.action()) {
+    case Watchdog::Action::None:
+      // Logged out after the timer fired.
+      return;
+    case Watchdog::Action::CheckOnline: {
+      auto online = false;
+      try {
+        online = session->_client.checkOnline();
+      } catch (const srun::SrunException& e) {
+        std::cerr << "Watchdog " << account << ": " << e.what() << "\n";
+      }
+
+      delay = watchdog.onCheck(online, Watchdog::Clock::now());
+      if (!online) {
+        std::cout << "Watchdog " << account << ": offline, logging in again\n";
+      }
+      break;
+    }
+    case Watchdog::Action::Login: {
+      auto online = false;
+      loginClient(session->_client, {}, [&](DrawLogin msg) {
+        online = msg.finished && !msg.err_msg;
+        if (msg.err_msg) {
+          std::cerr << "Watchdog " << account << ": " << *msg.err_msg << "\n";
+        }
+        // Nobody waits for the steps, only for the outcome.
+        if (msg.finished || msg.err_msg) {
+          report.send(
+              DrawAccount{.account = account, .update = std::move(msg)});
+        }
+      });
+
+      delay = watchdog.onLogin(online, Watchdog::Clock::now());
+      if (online) {
+        auto metrics = watchdog.metrics();
+        std::cout << "Watchdog " << account << ": back online after "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(
+                         metrics.last_time_to_recover)
+                         .count()
+                  << " ms\n";
+      } else if (watchdog.breakerOpen()) {
+        std::cerr << "Watchdog " << account
+                  << ": login keeps failing, retrying less often\n";
+      }
+      break;
+    }
+  }
+
+  scheduleWatch(session, delay);
+}
+
+auto SessionManager::scheduleWatch(const std::shared_ptr<Session>& session,
+                                   Watchdog::Clock::duration delay) -> void {
+  std::scoped_lock lock{_m};
+  if (session->_removed) {
+    return;
+  }
+
+  cancelWatch(*session);
+  auto id = _timers.schedule(_watch, delay);
+  session->_watch_timer = id;
+  _watch_timers.emplace(id, session);
+}
+
+auto SessionManager::stopWatch(Session& session) -> void {
+  session._watchdog.stop();
+  std::scoped_lock lock{_m};
+  cancelWatch(session);
+}
+
+auto SessionManager::cancelWatch(Session& session) -> void {
+  if (!session._watch_timer) {
+    return;
+  }
+
+  _timers.cancel(*session._watch_timer);
+  _watch_timers.erase(*session._watch_timer);
+  session._watch_timer.reset();
+}
+
+auto SessionManager::watchLoop() -> void {
+  auto timers = _watch.dispatcher(on<TimerFired>([this](const TimerFired& msg) {
+    std::scoped_lock lock{_m};
+    // Cancelled after it fired.
+    auto node = _watch_timers.extract(msg.id);
+    if (node.empty()) {
+      return;
+    }
+
+    node.mapped()->_watch_timer.reset();
+    push(node.mapped(), Op{OpKind::Watch, {}});
+  }));
+  while (!_watch.closed()) {
+    timers.wait();
+  }
+}
+
+}  // namespace srun_gui
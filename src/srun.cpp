@@ -1,168 +1,375 @@
 #include <srun/exception.h>
 
+#include <chrono>
 #include <iostream>
+#include <thread>
 #include <vector>
 
 #include "common/msg.h"
 #include "csp/dispatcher.h"
+#include "portal.h"
 #include "srun_backend.h"
 
 namespace srun_gui {
 
-auto SrunBackend::run() -> void {
-  try {
-    while (true) {
-      (this->*_state)();
-    }
-  } catch (const DispatcherExceptionGetCloseQueueMsg& e) {
-    std::cout << "Received CloseQueueMsg, exiting...\n";
-    return;
-  }
-}
+SrunBackend::SrunBackend() {
+  _receiver.recordLatency(_request_latency);
+  _network.recordLatency(_network_latency);
 
-void SrunBackend::idle() {
-  _receiver.wait<true>()
-      .dispatch<ErrMsg>([](const ErrMsg& msg) {
+  _control_dispatcher = _control.dispatcher();
+  _requests = _receiver.dispatcher(
+      on<ErrMsg>([](const ErrMsg& msg) {
         std::cerr << "SrunBack Error: " << msg.err_msg << "\n";
-      })
-      .dispatch<RequestLoadConfig>(
-          [this](const RequestLoadConfig& request_msg) {
-            std::cout << "Load config\n";
-            this->loadConfig(request_msg.config);
-            std::cout << "Load config done\n";
-          })
-      .dispatch<RequestLoadConfigFile>(
-          [this](const RequestLoadConfigFile& msg) {
-            std::cout << "Load config file\n";
-            this->loadConfigFile(msg.config_file);
-            std::cout << "Load config file done\n";
-          })
-      .dispatch<RequestLogin>([this](const RequestLogin& msg) {
+      }),
+      on<RequestLoadConfig>([this](const RequestLoadConfig& request_msg) {
+        std::cout << "Load config\n";
+        this->loadConfig(request_msg.config);
+        std::cout << "Load config done\n";
+      }),
+      on<RequestLoadConfigFile>([this](const RequestLoadConfigFile& msg) {
+        std::cout << "Load config file\n";
+        this->loadConfigFile(msg.config_file);
+        std::cout << "Load config file done\n";
+      }),
+      // Portal calls are passed on in arrival order, so they keep it.
+      on<RequestLogin>(
+          [this](RequestLogin& msg) { toNetwork(std::move(msg)); }),
+      on<RequestInfo>([this](RequestInfo& msg) { toNetwork(std::move(msg)); }),
+      on<RequestLogout>(
+          [this](RequestLogout& msg) { toNetwork(std::move(msg)); }),
+      on<InfoCall>([this](InfoCall& call) { toNetwork(std::move(call)); }),
+      on<RequestPollInfo>(
+          [this](RequestPollInfo& msg) { toNetwork(std::move(msg)); }),
+      // Account operations only queue on the session manager, so they
+      // never hold up the requests behind them.
+      on<RequestAddAccount>([this](const RequestAddAccount& msg) {
+        addAccount(msg.account, msg.config);
+      }),
+      on<RequestAddAccountFile>([this](const RequestAddAccountFile& msg) {
+        try {
+          addAccount(msg.account, readConfigFile(msg.config_file));
+        } catch (const srun::SrunException& e) {
+          sendToUi(ErrMsg{"Account " + msg.account + ": " + e.what()});
+        }
+      }),
+      on<RequestRemoveAccount>([this](const RequestRemoveAccount& msg) {
+        if (!_sessions->remove(msg.account)) {
+          checkAccount(false, msg.account);
+          return;
+        }
+        sendToUi(DrawAccount{.account = msg.account, .removed = true});
+      }),
+      on<RequestAccountLogin>([this](const RequestAccountLogin& msg) {
+        checkAccount(_sessions->login(msg.account, msg.cancel), msg.account);
+      }),
+      on<RequestAccountInfo>([this](const RequestAccountInfo& msg) {
+        checkAccount(_sessions->getInfo(msg.account, msg.cancel),
+                     msg.account);
+      }),
+      on<RequestAccountLogout>([this](const RequestAccountLogout& msg) {
+        checkAccount(_sessions->logout(msg.account, msg.cancel), msg.account);
+      }),
+      // Account reports pass through here on their way to the ui, so the
+      // observers see them too.
+      on<DrawAccount>([this](DrawAccount& msg) { sendToUi(std::move(msg)); }));
+  _network_requests = _network.dispatcher(
+      on<RequestLogin>([this](const RequestLogin& msg) {
         std::cout << "Login\n";
-        this->login();
+        this->login(msg.cancel);
         std::cout << "Login done\n";
-      })
-      .dispatch<RequestInfo>([this](const RequestInfo& msg) {
+      }),
+      on<RequestInfo>([this](const RequestInfo& msg) {
         std::cout << "Get info\n";
-        this->getInfo();
+        this->getInfo(&msg, nullptr);
         std::cout << "Get info done\n";
-      })
-      .dispatch<RequestLogout>([this](const RequestLogout& msg) {
+      }),
+      on<RequestLogout>([this](const RequestLogout& msg) {
         std::cout << "Logout\n";
-        this->logout();
+        this->logout(msg.cancel);
         std::cout << "Logout done\n";
-      });
+      }),
+      on<InfoCall>([this](const InfoCall& call) {
+        std::cout << "Get info (call " << call.id() << ")\n";
+        this->getInfo(nullptr, &call);
+        std::cout << "Get info done\n";
+      }),
+      on<RequestPollInfo>(
+          [this](const RequestPollInfo& msg) { this->startPolling(msg); }),
+      on<TimerFired>([this](const TimerFired& msg) {
+        this->pollInfo(msg);
+        this->watch(msg);
+      }));
 }
 
-auto SrunBackend::loadConfig(const Config& config) -> void {
-  if (!config.auto_ip) {
-    _client.setIp(config.ip);
+auto SrunBackend::run() -> void {
+  auto network = std::thread{[this] { networkLane(); }};
+  while (!_control.closed()) {
+    (this->*_state)();
+  }
+
+  // Requests sent from now on are refused instead of piling up. The network
+  // lane finishes its current portal call and drops the rest.
+  _receiver.close();
+  _network.close();
+  network.join();
+  std::cout << "Received CloseQueueMsg, exiting...\n";
+}
+
+void SrunBackend::idle() {
+  if (_select.wait() == CONTROL_CHANNEL) {
+    // The dispatcher handles CloseQueueMsg by closing the channel, which
+    // ends `run`.
+    _control_dispatcher.poll();
+    return;
+  }
+
+  // A CloseQueueMsg sent through getSender closes the request channel,
+  // which Select reports as ready from then on. End `run` the same way.
+  if (_requests.poll() == DispatchResult::Closed) {
+    _control.close();
+  }
+}
+
+auto SrunBackend::networkLane() -> void {
+  while (!_network.closed()) {
+    _network_requests.wait();
+  }
+}
+
+auto SrunBackend::applyConfig() -> void {
+  std::optional<Config> config;
+  {
+    std::scoped_lock lock{_config_mutex};
+    config.swap(_staged_config);
   }
 
-  if (!config.auto_ac_id) {
-    _client.setAcId(config.ac_id);
+  if (config) {
+    configureClient(_client, *config);
   }
+}
 
-  _client.setSsl(config.protocol == "https");
-  _client.setHost(config.host);
-  _client.setPort(config.port);
-  _client.setUsername(config.username);
-  _client.setPassword(config.password);
+auto SrunBackend::loadConfig(const Config& config) -> void {
+  std::scoped_lock lock{_config_mutex};
+  _staged_config = config;
 }
 
 auto SrunBackend::loadConfigFile(std::string_view config_file) -> void {
+  // Read with a scratch client; `_client` belongs to the network lane.
+  Config config;
   try {
-    _client.init(config_file);
-    sendToUi(DrawConfig{.err_msg = {},
-                        .finished = true,
-                        .config_file = std::string(config_file),
-                        .config = {.protocol = _client.ssl() ? "https" : "http",
-                                   .host = _client.host(),
-                                   .port = _client.port(),
-                                   .username = _client.username(),
-                                   .password = _client.password(),
-                                   .auto_ip = _client.autoIp(),
-                                   .ip = _client.ip(),
-                                   .auto_ac_id = _client.autoAcId(),
-                                   .ac_id = _client.acId()}});
+    config = readConfigFile(config_file);
   } catch (const srun::SrunException& e) {
     sendToUi(DrawConfig{.err_msg = e.what(),
                         .finished = false,
                         .config_file = std::string(config_file)});
     return;
   }
+
+  loadConfig(config);
+  sendToUi(DrawConfig{.err_msg = {},
+                      .finished = true,
+                      .config_file = std::string(config_file),
+                      .config = std::move(config)});
 }
 
-auto SrunBackend::login() -> void {
-  try {
-    // is online
-    if (_client.checkOnline()) {
-      sendToUi(DrawLogin{.finished = true, .username = _client.username()});
-      return;
+auto SrunBackend::login(const CancelToken& cancel) -> void {
+  applyConfig();
+  auto online = false;
+  auto started = std::chrono::steady_clock::now();
+  loginClient(_client, cancel, [&](DrawLogin msg) {
+    online = msg.finished && !msg.err_msg;
+    sendToUi(cancel, std::move(msg));
+  });
+  recordPortal(PORTAL_LOGIN, started);
+  if (online) {
+    startWatchdog();
+  }
+}
+
+auto SrunBackend::getInfo(const RequestInfo* request, const InfoCall* call)
+    -> void {
+  applyConfig();
+  // Duplicates right behind this request would only fetch the same info.
+  std::vector<MessagePtr> joined;
+  _network.takeQueued<RequestInfo, InfoCall>(joined);
+
+  auto for_each_waiter = [&](auto&& on_request, auto&& on_call) {
+    if (request != nullptr) {
+      on_request(*request);
+    }
+    if (call != nullptr) {
+      on_call(*call);
+    }
+    for (auto& msg : joined) {
+      if (msg->typeId() == messageTypeId<RequestInfo>()) {
+        on_request(static_cast<MessageWrapper<RequestInfo>&>(*msg).content());
+      } else {
+        on_call(static_cast<MessageWrapper<InfoCall>&>(*msg).content());
+      }
     }
+  };
 
-    sendToUi(DrawLogin{
-        .err_msg = {}, .finished = false, .username = _client.username()});
+  auto wanted = false;
+  for_each_waiter(
+      [&](const RequestInfo& r) { wanted = wanted || !r.cancel.cancelled(); },
+      [&](const InfoCall& c) { wanted = wanted || !c.cancelled(); });
+  if (!wanted) {
+    return;
+  }
 
-    _client.login();
+  auto started = std::chrono::steady_clock::now();
+  auto info = fetchInfo(_client);
+  recordPortal(PORTAL_INFO, started);
+  _poller.onResult(info, InfoPoller::Clock::now());
 
-    sendToUi(DrawLogin{
-        .err_msg = {},
-        .finished = true,
-        .username = _client.username(),
-    });
-  } catch (const srun::SrunException& e) {
-    sendToUi(DrawLogin{.err_msg = e.what(),
-                       .finished = false,
-                       .username = _client.username()});
+  // Requests that arrived while the portal answered join this flight.
+  _network.takeQueued<RequestInfo, InfoCall>(joined);
+  auto waiters = joined.size() + (request != nullptr ? 1 : 0) +
+                 (call != nullptr ? 1 : 0);
+  _flights.record<RequestInfo>(waiters);
+
+  // Pushed updates all land in the same ui state, so one is enough.
+  auto pushed = false;
+  for_each_waiter(
+      [&](const RequestInfo& r) {
+        if (!pushed && !r.cancel.cancelled()) {
+          sendToUi(r.cancel, info);
+          pushed = true;
+        }
+      },
+      [&](const InfoCall& c) { c.reply(info); });
+
+  if (1 < waiters) {
+    std::cout << "Get info served " << waiters << " requests, "
+              << _flights.counts<RequestInfo>().joined
+              << " portal calls saved so far\n";
+  }
+}
+
+auto SrunBackend::logout(const CancelToken& cancel) -> void {
+  applyConfig();
+  auto started = std::chrono::steady_clock::now();
+  auto msg = logoutClient(_client);
+  recordPortal(PORTAL_LOGOUT, started);
+  if (msg.finished) {
+    stopWatchdog();
+  }
+  sendToUi(cancel, std::move(msg));
+}
+
+auto SrunBackend::startPolling(const RequestPollInfo& request) -> void {
+  _poll_cancel = request.cancel;
+  _poller.setHidden(request.hidden);
+  if (_poll_timer) {
+    _timers.cancel(*_poll_timer);
+  }
+  _poll_timer = _timers.schedule(_network, _poller.nextDelay());
+}
+
+auto SrunBackend::pollInfo(const TimerFired& timer) -> void {
+  // Another timer, or this one fired before it was cancelled or replaced.
+  if (timer.id != _poll_timer) {
     return;
   }
+
+  _poll_timer.reset();
+  if (_poll_cancel.cancelled()) {
+    return;
+  }
+
+  applyConfig();
+  auto started = std::chrono::steady_clock::now();
+  auto info = fetchInfo(_client);
+  recordPortal(PORTAL_INFO, started);
+  if (_poller.onResult(info, InfoPoller::Clock::now())) {
+    sendToUi(_poll_cancel, std::move(info));
+  }
+  _poll_timer = _timers.schedule(_network, _poller.nextDelay());
 }
 
-auto SrunBackend::getInfo() -> void {
-  try {
-    sendToUi(makeDrawInfo(_client.getInfo()));
-  } catch (const srun::SrunException& e) {
-    sendToUi(DrawInfo{.err_msg = e.what(), .finished = false, .user_info = {}});
+auto SrunBackend::startWatchdog() -> void {
+  if (!_watchdog.enabled()) {
     return;
   }
+
+  if (_watchdog_timer) {
+    _timers.cancel(*_watchdog_timer);
+  }
+  _watchdog_timer =
+      _timers.schedule(_network, _watchdog.start(Watchdog::Clock::now()));
 }
 
-auto SrunBackend::makeDrawInfo(const srun::InfoResponse& info) -> DrawInfo {
-  std::vector<OnlineDeviceInfo> online_device_info;
-  for (const auto& device : info.onlineDevices()) {
-    online_device_info.push_back(
-        OnlineDeviceInfo{.class_name = device.className(),
-                         .ipv4 = device.ipv4(),
-                         .ipv6 = device.ipv6(),
-                         .os_name = device.osName(),
-                         .rad_online_id = device.radOnlineId()});
+auto SrunBackend::stopWatchdog() -> void {
+  _watchdog.stop();
+  if (_watchdog_timer) {
+    _timers.cancel(*_watchdog_timer);
+    _watchdog_timer.reset();
+  }
+}
+
+auto SrunBackend::watch(const TimerFired& timer) -> void {
+  if (timer.id != _watchdog_timer) {
+    return;
   }
 
-  return DrawInfo{
-      .err_msg = {},
-      .finished = true,
-      .user_info = {.username = info.username(),
-                    .online_ip = info.onlineIp(),
-                    .mac = info.userMac(),
-                    .wallet_balance = static_cast<double>(info.walletBalance()),
-                    .remain_seconds = info.remainSeconds(),
-                    .sum_seconds = info.sumSeconds(),
-                    .in_bytes = info.bytesIn(),
-                    .out_bytes = info.bytesOut(),
-                    .remain_bytes = info.remainBytes(),
-                    .sum_bytes = info.sumBytes(),
-                    .online_device_info = online_device_info}};
+  Watchdog::Clock::duration delay{};
+  if (_watchdog.action() == Watchdog::Action::CheckOnline) {
+    auto online = false;
+    auto started = std::chrono::steady_clock::now();
+    try {
+      online = _client.checkOnline();
+    } catch (const srun::SrunException& e) {
+      std::cerr << "Watchdog: " << e.what() << "\n";
+    }
+    recordPortal(PORTAL_CHECK_ONLINE, started);
+
+    delay = _watchdog.onCheck(online, Watchdog::Clock::now());
+    if (!online) {
+      std::cout << "Watchdog: offline, logging in again\n";
+    }
+  } else {
+    applyConfig();
+    auto online = false;
+    auto started = std::chrono::steady_clock::now();
+    loginClient(_client, {}, [&](const DrawLogin& msg) {
+      online = msg.finished && !msg.err_msg;
+      if (msg.err_msg) {
+        std::cerr << "Watchdog: " << *msg.err_msg << "\n";
+      }
+    });
+    recordPortal(PORTAL_LOGIN, started);
+
+    delay = _watchdog.onLogin(online, Watchdog::Clock::now());
+    if (online) {
+      auto metrics = _watchdog.metrics();
+      std::cout << "Watchdog: back online after "
+                << std::chrono::duration_cast<std::chrono::milliseconds>(
+                       metrics.last_time_to_recover)
+                       .count()
+                << " ms\n";
+    } else if (_watchdog.breakerOpen()) {
+      std::cerr << "Watchdog: login keeps failing, retrying less often\n";
+    }
+  }
+
+  _watchdog_timer = _timers.schedule(_network, delay);
 }
 
-auto SrunBackend::logout() -> void {
-  try {
-    _client.logout();
-    sendToUi(DrawLogout{.err_msg = {}, .finished = true});
-  } catch (const srun::SrunException& e) {
-    sendToUi(DrawLogout{.err_msg = e.what(), .finished = false});
+auto SrunBackend::addAccount(const std::string& account,
+                             const Config& config) -> void {
+  if (!_sessions->add(account, config)) {
+    sendToUi(ErrMsg{"Account already exists: " + account});
     return;
   }
+
+  sendToUi(DrawAccount{.account = account});
+}
+
+auto SrunBackend::checkAccount(bool known, const std::string& account)
+    -> void {
+  if (!known) {
+    sendToUi(ErrMsg{"Unknown account: " + account});
+  }
 }
 
 }  // namespace srun_gui
\ No newline at end of file
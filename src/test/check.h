@@ -0,0 +1,18 @@
+#ifndef __SRUN_GUI_TEST_CHECK_H__
+#define __SRUN_GUI_TEST_CHECK_H__
+
+#include <cstdio>
+#include <cstdlib>
+
+// Like assert, but also checked in release builds, which is what ctest
+// runs by default.
+#define CHECK(cond)                                                    \
+  do {                                                                 \
+    if (!(cond)) {                                                     \
+      std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__,      \
+                   __LINE__, #cond);                                   \
+      std::exit(1);                                                    \
+    }                                                                  \
+  } while (false)
+
+#endif  // __SRUN_GUI_TEST_CHECK_H__
@@ -0,0 +1,101 @@
+#include <cstddef>
+
+#include "check.h"
+#include "csp/dispatcher.h"
+#include "csp/receiver.h"
+
+namespace {
+
+struct Ping {
+  std::size_t value;
+};
+
+// Builds its dispatcher in the constructor, like Ui and SrunBackend.
+class Owner {
+ public:
+  Owner() {
+    _dispatcher = _receiver.dispatcher(srun_gui::on<Ping>(
+        [this](const Ping &ping) { _received += ping.value; }));
+  }
+
+  Owner(const Owner &) = delete;
+
+  Owner(Owner &&) noexcept = delete;
+
+  Owner &operator=(const Owner &) = delete;
+
+  Owner &operator=(Owner &&) noexcept = delete;
+
+  ~Owner() = default;
+
+  auto sender() const { return _receiver.getSender(); }
+
+  auto poll() { return _dispatcher.poll(); }
+
+  auto received() const { return _received; }
+
+ private:
+  srun_gui::Receiver _receiver;
+  srun_gui::AnyDispatcher _dispatcher;
+  std::size_t _received{0};
+};
+
+// Each instance dispatches to itself, whichever was built first.
+auto membersDispatchToTheirOwner() -> void {
+  Owner first;
+  Owner second;
+  CHECK(first.sender()->send(Ping{1}));
+  CHECK(second.sender()->send(Ping{10}));
+
+  CHECK(second.poll() == srun_gui::DispatchResult::Handled);
+  CHECK(first.poll() == srun_gui::DispatchResult::Handled);
+  CHECK(first.received() == 1);
+  CHECK(second.received() == 10);
+  CHECK(first.poll() == srun_gui::DispatchResult::Unhandled);
+}
+
+auto closeAndEmpty() -> void {
+  srun_gui::Receiver receiver;
+  srun_gui::AnyDispatcher dispatcher = receiver.dispatcher();
+  CHECK(receiver.getSender()->send(srun_gui::CloseQueueMsg{}));
+  CHECK(dispatcher.wait() == srun_gui::DispatchResult::Closed);
+  CHECK(receiver.closed());
+
+  srun_gui::AnyDispatcher empty;
+  CHECK(empty.poll() == srun_gui::DispatchResult::Unhandled);
+}
+
+// A reply, or a call dropped unanswered, runs `notify` to wake the caller.
+// A call the caller cancelled does not.
+auto callsNotify() -> void {
+  using PingCall = srun_gui::Call<Ping, Ping>;
+  srun_gui::Receiver receiver;
+  auto sender = receiver.getSender();
+  std::size_t notified = 0;
+  auto notify = [&notified] { ++notified; };
+  auto answered = sender->call<Ping>(Ping{1}, notify);
+  auto dropped = sender->call<Ping>(Ping{2}, notify);
+  auto cancelled = sender->call<Ping>(Ping{3}, notify);
+  CHECK(cancelled.cancel());
+
+  auto dispatcher = receiver.dispatcher(
+      srun_gui::on<PingCall>([](const PingCall &call) {
+        if (call.request().value == 1) {
+          call.reply(Ping{10});
+        }
+      }));
+  dispatcher.poll(srun_gui::DrainBudget{.max_messages = 3});
+  CHECK(answered.ready());
+  CHECK(answered.get().value == 10);
+  CHECK(dropped.status() == srun_gui::CallStatus::Broken);
+  CHECK(notified == 2);
+}
+
+}  // namespace
+
+int main() {
+  membersDispatchToTheirOwner();
+  closeAndEmpty();
+  callsNotify();
+  return 0;
+}
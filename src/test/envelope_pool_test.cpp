@@ -0,0 +1,132 @@
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <thread>
+
+#include "check.h"
+#include "csp/dispatcher.h"
+#include "csp/receiver.h"
+
+// Once the envelope pools have warmed up, sending and dispatching a message
+// must not touch the heap, neither on one thread nor across threads.
+
+namespace {
+
+std::atomic<std::size_t> allocations{0};
+
+constexpr std::size_t BURST = 64;
+constexpr std::size_t WARMUP = 10;
+constexpr std::size_t ROUNDS = 1000;
+
+struct Small {
+  std::uint64_t value;
+};
+
+// Close to EnvelopePool::ENVELOPE_SIZE, but still pooled.
+struct Large {
+  std::uint64_t value;
+  char padding[256];
+};
+
+auto sameThread() -> void {
+  srun_gui::Receiver receiver;
+  auto sender = receiver.getSender();
+  std::size_t handled = 0;
+  auto dispatcher = receiver.dispatcher(
+      srun_gui::on<Small>([&handled](const Small &) { ++handled; }),
+      srun_gui::on<Large>([&handled](const Large &) { ++handled; }));
+
+  const srun_gui::DrainBudget budget{.max_messages = BURST};
+  auto round = [&] {
+    for (std::size_t i = 0; i < BURST / 2; ++i) {
+      sender->send(Small{i});
+      sender->send(Large{i, {}});
+    }
+    dispatcher.poll(budget);
+  };
+
+  for (std::size_t i = 0; i < WARMUP; ++i) {
+    round();
+  }
+  auto pooled = sender->heapAllocations();
+  auto before = allocations.load();
+  for (std::size_t i = 0; i < ROUNDS; ++i) {
+    round();
+  }
+  CHECK(allocations.load() == before);
+  CHECK(sender->heapAllocations() == pooled);
+  CHECK(handled == (WARMUP + ROUNDS) * BURST);
+}
+
+// Blocks are recycled by the consumer thread and taken back by the producer.
+auto acrossThreads() -> void {
+  srun_gui::Receiver receiver;
+  auto sender = receiver.getSender();
+  std::size_t handled = 0;
+  auto dispatcher = receiver.dispatcher(
+      srun_gui::on<Small>([&handled](const Small &) { ++handled; }));
+
+  std::atomic<std::size_t> requested{0};
+  std::atomic<std::size_t> sent{0};
+  std::thread producer{[&] {
+    for (std::size_t round = 1; round <= WARMUP + ROUNDS; ++round) {
+      while (requested.load(std::memory_order_acquire) < round) {
+        std::this_thread::yield();
+      }
+      for (std::size_t i = 0; i < BURST; ++i) {
+        sender->send(Small{i});
+      }
+      sent.fetch_add(BURST, std::memory_order_release);
+    }
+  }};
+
+  auto round = [&](std::size_t n) {
+    requested.store(n, std::memory_order_release);
+    while (handled < n * BURST) {
+      dispatcher.wait();
+    }
+  };
+
+  // Blocks recycled while a burst is still being sent are reused within
+  // it, so the pool only grows to a full burst if it is queued at once.
+  requested.store(1, std::memory_order_release);
+  while (sent.load(std::memory_order_acquire) < BURST) {
+    std::this_thread::yield();
+  }
+  for (std::size_t n = 1; n <= WARMUP; ++n) {
+    round(n);
+  }
+  auto pooled = sender->heapAllocations();
+  auto before = allocations.load();
+  for (std::size_t n = WARMUP + 1; n <= WARMUP + ROUNDS; ++n) {
+    round(n);
+  }
+  auto after = allocations.load();
+  producer.join();
+  CHECK(after == before);
+  CHECK(sender->heapAllocations() == pooled);
+}
+
+}  // namespace
+
+auto operator new(std::size_t size) -> void * {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (auto *p = std::malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc{};
+}
+
+auto operator delete(void *p) noexcept -> void { std::free(p); }
+
+auto operator delete(void *p, std::size_t /*size*/) noexcept -> void {
+  std::free(p);
+}
+
+int main() {
+  sameThread();
+  acrossThreads();
+  return 0;
+}
@@ -0,0 +1,204 @@
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+#include "csp/dispatcher.h"
+#include "csp/receiver.h"
+
+namespace {
+
+constexpr std::size_t PRODUCERS = 4;
+constexpr std::size_t PUSHES = 20000;
+
+std::atomic<std::ptrdiff_t> live{0};
+
+// Coalesced. Counts its instances, so a lost or doubly freed one shows up.
+struct Latest {
+  Latest(std::size_t producer, std::size_t seq)
+      : producer{producer}, seq{seq} {
+    live.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  Latest(const Latest &other) : producer{other.producer}, seq{other.seq} {
+    live.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  Latest(Latest &&other) noexcept
+      : producer{other.producer}, seq{other.seq} {
+    live.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  Latest &operator=(const Latest &) = delete;
+
+  Latest &operator=(Latest &&) noexcept = delete;
+
+  ~Latest() { live.fetch_sub(1, std::memory_order_relaxed); }
+
+  std::size_t producer;
+  std::size_t seq;
+};
+
+struct Filler {
+  std::size_t value;
+};
+
+// Runs `produce(sender, producer)` on PRODUCERS threads, one Sender each.
+template <typename Produce>
+auto runProducers(const srun_gui::Receiver &receiver, Produce produce)
+    -> std::vector<std::thread> {
+  std::vector<std::thread> threads;
+  for (std::size_t i = 0; i < PRODUCERS; ++i) {
+    threads.emplace_back(
+        [produce, sender = std::shared_ptr{receiver.getSender()}, i] {
+          produce(*sender, i);
+        });
+  }
+  return threads;
+}
+
+// A full queue has no place for the slot, so no coalesced push may claim
+// its message was queued.
+auto coalesceIntoFullQueue() -> void {
+  srun_gui::Receiver receiver{srun_gui::QueueOptions{
+      .capacity = 1, .overflow = srun_gui::OverflowPolicy::Reject}};
+  receiver.coalesce<Latest>();
+  CHECK(receiver.getSender()->send(Filler{0}));
+
+  std::atomic<std::size_t> accepted{0};
+  auto threads =
+      runProducers(receiver, [&](srun_gui::Sender &sender, std::size_t i) {
+        for (std::size_t seq = 0; seq < PUSHES; ++seq) {
+          if (sender.send(Latest{i, seq})) {
+            accepted.fetch_add(1, std::memory_order_relaxed);
+          }
+        }
+      });
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  std::size_t delivered = 0;
+  auto dispatcher = receiver.dispatcher(
+      srun_gui::on<Latest>([&delivered](const Latest &) { ++delivered; }),
+      srun_gui::on<Filler>([](const Filler &) {}));
+  dispatcher.poll(srun_gui::DrainBudget{.max_messages = SIZE_MAX});
+  CHECK(accepted.load() == 0);
+  CHECK(delivered == 0);
+  CHECK(live.load() == 0);
+}
+
+// Producers race for the slot of a small queue that keeps rejecting while
+// the consumer drains it. Every message is freed exactly once, each
+// producer's messages arrive in order, and once a push was accepted the
+// consumer gets a message.
+auto coalesceUnderReject() -> void {
+  srun_gui::Receiver receiver{srun_gui::QueueOptions{
+      .capacity = 4, .overflow = srun_gui::OverflowPolicy::Reject}};
+  receiver.coalesce<Latest>();
+
+  std::atomic<std::size_t> accepted{0};
+  std::atomic<std::size_t> running{PRODUCERS};
+  auto threads =
+      runProducers(receiver, [&](srun_gui::Sender &sender, std::size_t i) {
+        for (std::size_t seq = 0; seq < PUSHES; ++seq) {
+          if (sender.send(Latest{i, seq})) {
+            accepted.fetch_add(1, std::memory_order_relaxed);
+          }
+          sender.send(Filler{seq});
+        }
+        running.fetch_sub(1, std::memory_order_release);
+      });
+
+  std::size_t delivered = 0;
+  std::array<std::size_t, PRODUCERS> next_seq{};
+  auto dispatcher = receiver.dispatcher(
+      srun_gui::on<Latest>([&](const Latest &latest) {
+        CHECK(latest.seq >= next_seq[latest.producer]);
+        next_seq[latest.producer] = latest.seq + 1;
+        ++delivered;
+      }),
+      srun_gui::on<Filler>([](const Filler &) {}));
+  const srun_gui::DrainBudget budget{.max_messages = SIZE_MAX};
+  while (running.load(std::memory_order_acquire) != 0) {
+    dispatcher.poll(budget);
+    std::this_thread::yield();
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  dispatcher.poll(budget);
+
+  CHECK(accepted.load() != 0);
+  CHECK(delivered != 0);
+  CHECK(delivered <= accepted.load());
+  CHECK(receiver.size() == 0);
+  CHECK(live.load() == 0);
+}
+
+// Messages of one sender keep their order within a lane, while a higher
+// lane overtakes whatever was sent before it in a lower one.
+auto laneOrder() -> void {
+  srun_gui::Receiver receiver;
+  auto sender = receiver.getSender();
+  sender->send(Filler{0}, srun_gui::Lane::Bulk);
+  sender->send(Filler{1}, srun_gui::Lane::Normal);
+  sender->send(Filler{2}, srun_gui::Lane::Bulk);
+  sender->send(Filler{3}, srun_gui::Lane::Control);
+  sender->send(Filler{4}, srun_gui::Lane::Normal);
+
+  std::vector<std::size_t> order;
+  auto dispatcher = receiver.dispatcher(srun_gui::on<Filler>(
+      [&order](const Filler &filler) { order.push_back(filler.value); }));
+  dispatcher.poll(srun_gui::DrainBudget{.max_messages = SIZE_MAX});
+  CHECK((order == std::vector<std::size_t>{3, 1, 4, 0, 2}));
+}
+
+struct Urgent {};
+
+// A control message sent behind a bulk backlog is the next one handled,
+// also while a producer keeps adding to the backlog.
+auto controlAheadOfBulkBacklog() -> void {
+  constexpr std::size_t BACKLOG = 100000;
+  srun_gui::Receiver receiver;
+  auto bulk = receiver.getSender();
+  for (std::size_t i = 0; i < BACKLOG; ++i) {
+    bulk->send(Filler{i}, srun_gui::Lane::Bulk);
+  }
+
+  std::atomic<bool> flooding{true};
+  auto flooder = receiver.getSender();
+  std::thread flood{[&] {
+    for (std::size_t i = 0; flooding.load(std::memory_order_relaxed); ++i) {
+      flooder->send(Filler{i}, srun_gui::Lane::Bulk);
+    }
+  }};
+
+  std::size_t handled_bulk = 0;
+  std::size_t bulk_before_urgent = SIZE_MAX;
+  auto dispatcher = receiver.dispatcher(
+      srun_gui::on<Filler>([&](const Filler &) { ++handled_bulk; }),
+      srun_gui::on<Urgent>(
+          [&](const Urgent &) { bulk_before_urgent = handled_bulk; }));
+  CHECK(receiver.getSender()->send(Urgent{}, srun_gui::Lane::Control));
+  dispatcher.poll(srun_gui::DrainBudget{.max_messages = 1});
+  flooding.store(false, std::memory_order_relaxed);
+  flood.join();
+
+  CHECK(bulk_before_urgent == 0);
+  CHECK(receiver.size() >= BACKLOG);
+}
+
+}  // namespace
+
+int main() {
+  coalesceIntoFullQueue();
+  coalesceUnderReject();
+  laneOrder();
+  controlAheadOfBulkBacklog();
+  return 0;
+}
@@ -2,15 +2,16 @@
 
 #include <algorithm>
 #include <array>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
 #include <cstdio>
 #include <format>
 #include <functional>
 #include <iostream>
-#include <regex>
 #include <string>
 #include <utility>
+#include <variant>
 
 #include "ImGuiFileDialog.h"
 #include "common/msg.h"
@@ -18,11 +19,13 @@
 
 namespace srun_gui {
 
-static const std::regex URL_REGEX(
-    R"(^(http|https):\/\/([a-zA-Z0-9.-]+):(\d+)$)");
-
 static constexpr std::size_t MAX_PATH_SIZE = 1024;
 static constexpr std::size_t MAX_SHORT_STR_SIZE = 256;
+// Bounds the backlog while the window is iconified and not drained.
+static constexpr std::size_t UI_QUEUE_CAPACITY = 256;
+static constexpr std::size_t UI_STASH_CAPACITY = 16;
+static constexpr auto UI_STASH_MAX_AGE = std::chrono::seconds{5};
+static constexpr auto UI_STASH_INFO_MAX_AGE = std::chrono::seconds{30};
 
 // Config State
 static bool show_config_error = false;
@@ -37,89 +40,171 @@ static std::array<std::uint8_t, 4> ip_parts = {0, 0, 0, 0};
 static bool auto_ip = true;
 static bool auto_ac_id = true;
 static int ac_id = 1;
+// Set when the fields above change, so the url is only rebuilt and checked
+// then instead of every frame.
+static bool config_dirty = true;
+static std::string url;
+static bool valid_url = false;
+// Longer than the small string buffer, so it is built once instead of by
+// every call that takes a std::string.
+static const std::string CONFIG_DIALOG_KEY = "ChooseFileDlgKey";
+
+// Matches what `^(http|https)://[a-zA-Z0-9.-]+:\d+$` would.
+static auto isValidUrl(std::string_view candidate) -> bool {
+  auto scheme_end = candidate.find("://");
+  if (scheme_end == std::string_view::npos) {
+    return false;
+  }
+
+  auto scheme = candidate.substr(0, scheme_end);
+  if (scheme != "http" && scheme != "https") {
+    return false;
+  }
+
+  candidate.remove_prefix(scheme_end + 3);
+  auto host_end = candidate.find(':');
+  if (host_end == std::string_view::npos) {
+    return false;
+  }
+
+  auto name = candidate.substr(0, host_end);
+  auto digits = candidate.substr(host_end + 1);
+  auto is_digit = [](char c) { return '0' <= c && c <= '9'; };
+  auto is_host_char = [&is_digit](char c) {
+    return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || is_digit(c) ||
+           c == '.' || c == '-';
+  };
+  return !name.empty() && !digits.empty() &&
+         std::ranges::all_of(name, is_host_char) &&
+         std::ranges::all_of(digits, is_digit);
+}
+
+Ui::Ui()
+    : _receiver{QueueOptions{.capacity = UI_QUEUE_CAPACITY,
+                             .overflow = OverflowPolicy::DropOldest}} {
+  // Snapshot messages only matter in their newest form.
+  _receiver.coalesce<DrawInfo>().coalesce<DrawLogin>().coalesce<DrawLogout>();
+  // Results that arrive while another state is drawn are replayed once a
+  // state that handles them runs, instead of being lost.
+  _receiver
+      .selective(StashOptions{.capacity = UI_STASH_CAPACITY,
+                              .max_age = UI_STASH_MAX_AGE})
+      .stashMaxAge<DrawInfo>(UI_STASH_INFO_MAX_AGE);
+  _window.coalesce<RequestShowWindow>();
+  _receiver.recordLatency(_latency);
+
+  _window_dispatcher = _window.dispatcher(
+      on<RequestShowWindow>([this](const RequestShowWindow& msg) {
+        _window_request = msg.show;
+      }));
+  _idle_dispatcher = idleDispatcher();
+  _wait_dispatcher = waitDispatcher();
+  _info_dispatcher = infoDispatcher();
+}
+
+auto Ui::windowRequest() -> std::optional<bool> {
+  _window_dispatcher.poll();
+  return std::exchange(_window_request, std::nullopt);
+}
 
 auto Ui::loadConfig(std::string_view config_file) -> void {
   sendToSrun(RequestLoadConfigFile{.config_file = std::string(config_file)});
 }
 
+auto Ui::idleDispatcher() -> AnyDispatcher {
+  return _receiver.dispatcher(
+      on<ErrMsg>([this](const ErrMsg& msg) {
+        std::cerr << std::format("Ui Error: {}", msg.err_msg) << "\n";
+        auto center = ImGui::GetMainViewport()->GetCenter();
+        ImGui::SetNextWindowPos(center, ImGuiCond_Appearing, ImVec2(0.5, 0.5));
+        _idle_popup.id = popupId(PopupType::Error);
+        ImGui::OpenPopup(_idle_popup.id);
+        _idle_popup.msg = std::format("Error: {}", msg.err_msg);
+        _idle_popup.callback = [this]() { _idle_popup.enable_handle = true; };
+        _idle_popup.enable_handle = false;
+        _stop_drain = true;
+      }),
+      on<DrawConfig>([this](const DrawConfig& msg) {
+        if (msg.err_msg.has_value()) {
+          show_config_error = true;
+          config_path_erro = msg.err_msg.value();
+          return;
+        }
+
+        if (!msg.finished) {
+          return;
+        }
+
+        show_config_error = false;
+        _config = msg.config;
+        if ((sizeof(text_config_path)) < msg.config_file.size()) {
+          std::cout << std::format("Config file path too long: {}. Cut\n",
+                                   msg.config_file);
+          auto new_name = std::format(
+              "...{}", msg.config_file.substr(msg.config_file.size() -
+                                              sizeof(text_config_path) + 4));
+          std::ranges::copy(new_name, text_config_path);
+        } else {
+          std::ranges::copy(msg.config_file, text_config_path);
+        }
+
+        protocol_item_current = _config.protocol == "https" ? 1 : 0;
+        std::ranges::copy(_config.host, host);
+        port = std::stoi(_config.port);
+        std::ranges::copy(_config.username, username);
+        std::ranges::copy(_config.password, password);
+        auto_ip = _config.auto_ip;
+        auto_ac_id = _config.auto_ac_id;
+        if (!auto_ip) {
+          auto_ip = false;
+          std::sscanf(_config.ip.c_str(), "%hhu.%hhu.%hhu.%hhu",
+                      ip_parts.data(), &ip_parts[1], &ip_parts[2],
+                      &ip_parts[3]);
+        }
+        if (!auto_ac_id) {
+          ac_id = _config.ac_id;
+        }
+        config_dirty = true;
+      }),
+      // E.g. a login through the control socket. Failures are the caller's
+      // to report.
+      on<DrawLogin>([this](const DrawLogin& msg) {
+        if (msg.err_msg.has_value()) {
+          return;
+        }
+
+        toWaiting(msg.finished ? "Getting user info..." : "Login...", false,
+                  [this]() { configWidget(); });
+        if (msg.finished) {
+          sendToSrun(RequestInfo{.cancel = newOperation()});
+        }
+      }),
+      on<DrawAccount>([this](const DrawAccount& msg) { updateAccount(msg); }));
+}
+
 auto Ui::drawIdle() -> void {
   bool show_window = true;
-  static std::string popup_msg = "UNKNOWN ERROR";
-  static const char* popup_id = popupId(PopupType::Unknown);
-  static std::function<void()> popup_callback{};
-  static bool enable_handle = true;
 
   ImGui::Begin("Hello, world!", &show_window,
                ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoMove |
                    ImGuiWindowFlags_NoResize);
 
-  if (enable_handle) {
-    _receiver.wait<false>()
-        .dispatch<ErrMsg>([this](const ErrMsg& msg) {
-          std::cerr << std::format("Ui Error: {}", msg.err_msg) << "\n";
-          auto center = ImGui::GetMainViewport()->GetCenter();
-          ImGui::SetNextWindowPos(center, ImGuiCond_Appearing,
-                                  ImVec2(0.5, 0.5));
-          popup_id = popupId(PopupType::Error);
-          ImGui::OpenPopup(popup_id);
-          popup_msg = std::format("Error: {}", msg.err_msg);
-          popup_callback = [this]() { enable_handle = true; };
-          enable_handle = false;
-        })
-        .dispatch<DrawConfig>([this](const DrawConfig& msg) {
-          if (msg.err_msg.has_value()) {
-            show_config_error = true;
-            config_path_erro = msg.err_msg.value();
-            return;
-          }
-
-          if (!msg.finished) {
-            return;
-          }
-
-          show_config_error = false;
-          _config = msg.config;
-          if ((sizeof(text_config_path)) < msg.config_file.size()) {
-            std::cout << std::format("Config file path too long: {}. Cut\n",
-                                     msg.config_file);
-            auto new_name = std::format(
-                "...{}", msg.config_file.substr(msg.config_file.size() -
-                                                sizeof(text_config_path) + 4));
-            std::ranges::copy(new_name, text_config_path);
-          } else {
-            std::ranges::copy(msg.config_file, text_config_path);
-          }
-
-          protocol_item_current = _config.protocol == "https" ? 1 : 0;
-          std::ranges::copy(_config.host, host);
-          port = std::stoi(_config.port);
-          std::ranges::copy(_config.username, username);
-          std::ranges::copy(_config.password, password);
-          auto_ip = _config.auto_ip;
-          auto_ac_id = _config.auto_ac_id;
-          if (!auto_ip) {
-            auto_ip = false;
-            std::sscanf(_config.ip.c_str(), "%hhu.%hhu.%hhu.%hhu",
-                        ip_parts.data(), &ip_parts[1], &ip_parts[2],
-                        &ip_parts[3]);
-          }
-          if (!auto_ac_id) {
-            ac_id = _config.ac_id;
-          }
-        });
+  if (_idle_popup.enable_handle) {
+    _idle_dispatcher.poll(_drain_budget);
   }
 
   configWidget();
+  accountsWidget();
 
   // FIXME(franzero): The problem is that the _state is transitioned to other
   // state while this Popup is still open.
-  if (ImGui::BeginPopupModal(popup_id, nullptr,
+  if (ImGui::BeginPopupModal(_idle_popup.id, nullptr,
                              ImGuiWindowFlags_AlwaysAutoResize)) {
-    ImGui::Text("%s", popup_msg.c_str());
+    ImGui::Text("%s", _idle_popup.msg.c_str());
     if (ImGui::Button("OK", ImVec2(120, 0))) {
       ImGui::CloseCurrentPopup();
-      if (popup_callback) {
-        popup_callback();
+      if (_idle_popup.callback) {
+        _idle_popup.callback();
       }
     }
     ImGui::EndPopup();
@@ -132,105 +217,108 @@ auto Ui::drawIdle() -> void {
 static std::string waiting_overlay_text = "Connecting...";  // Progress text
 static bool enable_cancel = true;
 static std::function<void()> waiting_widget = nullptr;
-auto Ui::drawWait() -> void {
-  static std::string waiting_title = "Waiting";
-  static bool enable_handle = true;  // Enable handle message
-  static std::string popup_msg = "UNKNOWN ERROR";
-  static const char* popup_id = popupId(PopupType::Unknown);
-  static std::function<void()> popup_callback{};
+auto Ui::waitDispatcher() -> AnyDispatcher {
+  return _receiver.dispatcher(
+      on<ErrMsg>([this](const ErrMsg& msg) {
+        auto center = ImGui::GetMainViewport()->GetCenter();
+        ImGui::SetNextWindowPos(center, ImGuiCond_Appearing, ImVec2(0.5, 0.5));
+        _wait_popup.id = popupId(PopupType::Error);
+        ImGui::OpenPopup(_wait_popup.id);
+        _wait_popup.msg = "Error: " + msg.err_msg;
+        _wait_popup.callback = [this]() {
+          revertState();
+          _wait_popup.enable_handle = true;
+        };
+        _wait_popup.enable_handle = false;
+        _stop_drain = true;
+      }),
+      on<DrawLogin>([this](const DrawLogin& msg) {
+        if (msg.err_msg.has_value()) {
+          auto center = ImGui::GetMainViewport()->GetCenter();
+          ImGui::SetNextWindowPos(center, ImGuiCond_Appearing,
+                                  ImVec2(0.5, 0.5));
+          _wait_popup.id = popupId(PopupType::Error);
+          ImGui::OpenPopup(_wait_popup.id);
+          _wait_popup.msg = "Error: " + msg.err_msg.value();
+          _wait_popup.callback = [this]() {
+            revertState();
+            _wait_popup.enable_handle = true;
+          };
+          _wait_popup.enable_handle = false;
+          _stop_drain = true;
+          return;
+        }
 
-  ImGui::Begin(waiting_title.c_str(), nullptr,
-               ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoMove |
-                   ImGuiWindowFlags_NoResize);
+        if (!msg.finished) {
+          waiting_overlay_text = "Login...";
+          return;
+        }
 
-  if (enable_handle) {
-    // Handle message
-    _receiver.wait<false>()
-        .dispatch<ErrMsg>([this](const ErrMsg& msg) {
+        waiting_overlay_text = "Getting user info...";
+        sendToSrun(RequestInfo{.cancel = _operation.token()});
+      }),
+      on<DrawInfo>([this](const DrawInfo& msg) {
+        if (msg.err_msg.has_value()) {
           auto center = ImGui::GetMainViewport()->GetCenter();
           ImGui::SetNextWindowPos(center, ImGuiCond_Appearing,
                                   ImVec2(0.5, 0.5));
-          popup_id = popupId(PopupType::Error);
-          ImGui::OpenPopup(popup_id);
-          popup_msg = "Error: " + msg.err_msg;
-          popup_callback = [this]() {
+          _wait_popup.id = popupId(PopupType::Error);
+          ImGui::OpenPopup(_wait_popup.id);
+          _wait_popup.msg = "Error: " + msg.err_msg.value();
+          _wait_popup.callback = [this]() {
             revertState();
-            enable_handle = true;
+            _wait_popup.enable_handle = true;
           };
-          enable_handle = false;
-        })
-        .dispatch<DrawLogin>([this](const DrawLogin& msg) {
-          if (msg.err_msg.has_value()) {
-            auto center = ImGui::GetMainViewport()->GetCenter();
-            ImGui::SetNextWindowPos(center, ImGuiCond_Appearing,
-                                    ImVec2(0.5, 0.5));
-            popup_id = popupId(PopupType::Error);
-            ImGui::OpenPopup(popup_id);
-            popup_msg = "Error: " + msg.err_msg.value();
-            popup_callback = [this]() {
-              revertState();
-              enable_handle = true;
-            };
-            enable_handle = false;
-            return;
-          }
-
-          if (!msg.finished) {
-            waiting_overlay_text = "Login...";
-            return;
-          }
+          _wait_popup.enable_handle = false;
+          _stop_drain = true;
+          return;
+        }
 
+        if (!msg.finished) {
           waiting_overlay_text = "Getting user info...";
-          sendToSrun(RequestInfo{});
-        })
-        .dispatch<DrawInfo>([this](const DrawInfo& msg) {
-          if (msg.err_msg.has_value()) {
-            auto center = ImGui::GetMainViewport()->GetCenter();
-            ImGui::SetNextWindowPos(center, ImGuiCond_Appearing,
-                                    ImVec2(0.5, 0.5));
-            popup_id = popupId(PopupType::Error);
-            ImGui::OpenPopup(popup_id);
-            popup_msg = "Error: " + msg.err_msg.value();
-            popup_callback = [this]() {
-              revertState();
-              enable_handle = true;
-            };
-            enable_handle = false;
-            return;
-          }
-
-          if (!msg.finished) {
-            waiting_overlay_text = "Getting user info...";
-            return;
-          }
-
-          _user_info = msg.user_info;
-          transitState(&Ui::drawInfo);
-        })
-        .dispatch<DrawLogout>([this](const DrawLogout& msg) {
-          if (msg.err_msg.has_value()) {
-            auto center = ImGui::GetMainViewport()->GetCenter();
-            ImGui::SetNextWindowPos(center, ImGuiCond_Appearing,
-                                    ImVec2(0.5, 0.5));
-            popup_id = popupId(PopupType::Error);
-            ImGui::OpenPopup(popup_id);
-            popup_msg = "Error: " + msg.err_msg.value();
-            popup_callback = [this]() { revertState(); };
-            return;
-          }
+          return;
+        }
 
-          if (!msg.finished) {
-            waiting_overlay_text = "Logout...";
-            return;
-          }
+        updateUserInfo(msg.user_info);
+        transitState(&Ui::drawInfo);
+      }),
+      on<DrawLogout>([this](const DrawLogout& msg) {
+        if (msg.err_msg.has_value()) {
           auto center = ImGui::GetMainViewport()->GetCenter();
           ImGui::SetNextWindowPos(center, ImGuiCond_Appearing,
                                   ImVec2(0.5, 0.5));
-          popup_id = popupId(PopupType::Info);
-          ImGui::OpenPopup(popup_id);
-          popup_msg = "Logout success.";
-          popup_callback = [this]() { transitState(&Ui::drawIdle); };
-        });
+          _wait_popup.id = popupId(PopupType::Error);
+          ImGui::OpenPopup(_wait_popup.id);
+          _wait_popup.msg = "Error: " + msg.err_msg.value();
+          _wait_popup.callback = [this]() { revertState(); };
+          _stop_drain = true;
+          return;
+        }
+
+        if (!msg.finished) {
+          waiting_overlay_text = "Logout...";
+          return;
+        }
+        auto center = ImGui::GetMainViewport()->GetCenter();
+        ImGui::SetNextWindowPos(center, ImGuiCond_Appearing, ImVec2(0.5, 0.5));
+        _wait_popup.id = popupId(PopupType::Info);
+        ImGui::OpenPopup(_wait_popup.id);
+        _wait_popup.msg = "Logout success.";
+        _wait_popup.callback = [this]() { transitState(&Ui::drawIdle); };
+        _stop_drain = true;
+      }),
+      on<DrawAccount>([this](const DrawAccount& msg) { updateAccount(msg); }));
+}
+
+auto Ui::drawWait() -> void {
+  static std::string waiting_title = "Waiting";
+
+  ImGui::Begin(waiting_title.c_str(), nullptr,
+               ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoMove |
+                   ImGuiWindowFlags_NoResize);
+
+  if (_wait_popup.enable_handle) {
+    _wait_dispatcher.poll(_drain_budget);
   }
 
   {
@@ -252,6 +340,7 @@ auto Ui::drawWait() -> void {
     // Cancel button
     if (enable_cancel) {
       if (ImGui::Button("Cancel", ImVec2(-1, 0))) {
+        _operation.cancel();
         revertState();
       }
     }
@@ -259,13 +348,13 @@ auto Ui::drawWait() -> void {
 
   {
     // Alert popup
-    if (ImGui::BeginPopupModal(popup_id, nullptr,
+    if (ImGui::BeginPopupModal(_wait_popup.id, nullptr,
                                ImGuiWindowFlags_AlwaysAutoResize)) {
-      ImGui::Text("%s", popup_msg.c_str());
+      ImGui::Text("%s", _wait_popup.msg.c_str());
       if (ImGui::Button("OK", ImVec2(120, 0))) {
         ImGui::CloseCurrentPopup();
-        if (popup_callback) {
-          popup_callback();
+        if (_wait_popup.callback) {
+          _wait_popup.callback();
         }
       }
       ImGui::EndPopup();
@@ -275,16 +364,12 @@ auto Ui::drawWait() -> void {
   ImGui::End();
 }
 
-auto Ui::drawInfo() -> void {
-  ImGui::Begin("Info", nullptr,
-               ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoMove |
-                   ImGuiWindowFlags_NoResize);
-
-  _receiver.wait<false>()
-      .dispatch<ErrMsg>([](const ErrMsg& msg) {
+auto Ui::infoDispatcher() -> AnyDispatcher {
+  return _receiver.dispatcher(
+      on<ErrMsg>([](const ErrMsg& msg) {
         std::cerr << "Ui Error: " << msg.err_msg << "\n";
-      })
-      .dispatch<DrawInfo>([this](const DrawInfo& msg) {
+      }),
+      on<DrawInfo>([this](const DrawInfo& msg) {
         if (msg.err_msg.has_value()) {
           std::cerr << "Ui Error: " << msg.err_msg.value() << "\n";
           return;
@@ -294,10 +379,25 @@ auto Ui::drawInfo() -> void {
           return;
         }
 
-        _user_info = msg.user_info;
-      });
-  // TODO(franzero): Register timer to get info every 5 seconds
+        updateUserInfo(msg.user_info);
+      }),
+      // E.g. a logout through the control socket.
+      on<DrawLogout>([this](const DrawLogout& msg) {
+        if (msg.finished) {
+          transitState(&Ui::drawIdle);
+        }
+      }),
+      on<DrawAccount>([this](const DrawAccount& msg) { updateAccount(msg); }));
+}
+
+auto Ui::drawInfo() -> void {
+  ImGui::Begin("Info", nullptr,
+               ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoMove |
+                   ImGuiWindowFlags_NoResize);
+
+  _info_dispatcher.poll(_drain_budget);
   infoWidget();
+  accountsWidget();
 
   ImGui::End();
 }
@@ -316,9 +416,9 @@ auto Ui::configWidget() -> void {
       config.path = ".";
       // TODO(franzero): Set size
       ImGuiFileDialog::Instance()->OpenDialog(
-          "ChooseFileDlgKey", "Choose Config File", ".json,.*", config);
+          CONFIG_DIALOG_KEY, "Choose Config File", ".json,.*", config);
     }
-    if (ImGuiFileDialog::Instance()->Display("ChooseFileDlgKey")) {
+    if (ImGuiFileDialog::Instance()->Display(CONFIG_DIALOG_KEY)) {
       if (ImGuiFileDialog::Instance()->IsOk()) {
         std::string file_path_name =
             ImGuiFileDialog::Instance()->GetFilePathName();
@@ -334,25 +434,28 @@ auto Ui::configWidget() -> void {
     ImGui::PushItemWidth(80);
     const char* protocol_items[] = {"http", "https"};
 
-    protocol_item_current = _config.protocol == "https" ? 1 : 0;
-    ImGui::Combo("##protocol", &protocol_item_current, protocol_items,
-                 IM_ARRAYSIZE(protocol_items), ImGuiComboFlags_WidthFitPreview);
+    config_dirty |= ImGui::Combo("##protocol", &protocol_item_current,
+                                 protocol_items, IM_ARRAYSIZE(protocol_items),
+                                 ImGuiComboFlags_WidthFitPreview);
     ImGui::PopItemWidth();
     ImGui::SameLine();
-    ImGui::InputTextWithHint("##host", "host", host, sizeof(host));
+    config_dirty |=
+        ImGui::InputTextWithHint("##host", "host", host, sizeof(host));
     ImGui::SameLine();
     ImGui::PushItemWidth(80);
-    ImGui::InputScalar("##port", ImGuiDataType_U16, &port, nullptr, nullptr,
-                       nullptr, ImGuiInputTextFlags_CharsDecimal);
+    config_dirty |=
+        ImGui::InputScalar("##port", ImGuiDataType_U16, &port, nullptr,
+                           nullptr, nullptr, ImGuiInputTextFlags_CharsDecimal);
     ImGui::PopItemWidth();
-    _config.protocol = protocol_items[protocol_item_current];
-    _config.host = host;
-    _config.port = std::to_string(port);
-
-    static std::string url;
-    static bool valid_url = false;
-    url = _config.protocol + "://" + host + ":" + std::to_string(port);
-    valid_url = std::regex_match(url, URL_REGEX);
+    if (config_dirty) {
+      _config.protocol = protocol_items[protocol_item_current];
+      _config.host = host;
+      _config.port = std::to_string(port);
+      url = _config.protocol + "://" + _config.host + ":" + _config.port;
+      valid_url = isValidUrl(url);
+      config_dirty = false;
+    }
+
     if (!valid_url) {
       ImGui::TextColored(ImVec4(1, 0, 0, 1), "Invalid URL:");
     } else {
@@ -374,7 +477,7 @@ auto Ui::configWidget() -> void {
     if (ImGui::TreeNode("More Option")) {
       ImGui::Text("AC ID:");
       ImGui::SameLine();
-      ImGui::Checkbox("##AcIdAuto", &auto_ac_id);
+      auto ac_id_changed = ImGui::Checkbox("##AcIdAuto", &auto_ac_id);
       // tooltip
       if (ImGui::IsItemHovered()) {
         ImGui::BeginTooltip();
@@ -386,15 +489,17 @@ auto Ui::configWidget() -> void {
       if (auto_ac_id) {
         ImGui::Text("Auto");
       } else {
-        ImGui::InputInt("##AcId", &ac_id, 0, 0);
+        ac_id_changed |= ImGui::InputInt("##AcId", &ac_id, 0, 0);
       }
       ImGui::PopItemWidth();
-      _config.auto_ac_id = auto_ac_id;
-      _config.ac_id = ac_id;
+      if (ac_id_changed) {
+        _config.auto_ac_id = auto_ac_id;
+        _config.ac_id = ac_id;
+      }
 
       ImGui::Text("IP:");
       ImGui::SameLine(78);
-      ImGui::Checkbox("##AutoIp", &auto_ip);
+      auto ip_changed = ImGui::Checkbox("##AutoIp", &auto_ip);
       if (ImGui::IsItemHovered()) {
         ImGui::BeginTooltip();
         ImGui::Text("uncheck to input");
@@ -404,12 +509,15 @@ auto Ui::configWidget() -> void {
       if (auto_ip) {
         ImGui::Text("Auto");
       } else {
-        ImGui::InputScalarN("##ip", ImGuiDataType_U8, ip_parts.data(), 4,
-                            nullptr, nullptr, "%d");
+        ip_changed |= ImGui::InputScalarN("##ip", ImGuiDataType_U8,
+                                          ip_parts.data(), 4, nullptr,
+                                          nullptr, "%d");
+      }
+      if (ip_changed) {
+        _config.auto_ip = auto_ip;
+        _config.ip = std::format("{}.{}.{}.{}", ip_parts[0], ip_parts[1],
+                                 ip_parts[2], ip_parts[3]);
       }
-      _config.auto_ip = auto_ip;
-      _config.ip = std::format("{}.{}.{}.{}", ip_parts[0], ip_parts[1],
-                               ip_parts[2], ip_parts[3]);
 
       ImGui::TreePop();
     }
@@ -418,18 +526,22 @@ auto Ui::configWidget() -> void {
   {  // username and password
     ImGui::Text("Username:");
     ImGui::SameLine();
-    ImGui::InputText("##username", username, sizeof(username));
-    _config.username = username;
+    if (ImGui::InputText("##username", username, sizeof(username))) {
+      _config.username = username;
+    }
 
     static bool show_password = false;
     ImGui::Text("Password:");
     ImGui::SameLine();
-    ImGui::InputText("##password", password, sizeof(password),
-                     !show_password ? ImGuiInputTextFlags_Password
-                                    : ImGuiInputTextFlags_None);
+    auto password_changed =
+        ImGui::InputText("##password", password, sizeof(password),
+                         !show_password ? ImGuiInputTextFlags_Password
+                                        : ImGuiInputTextFlags_None);
     ImGui::SameLine();
     ImGui::Checkbox("Show Password", &show_password);
-    _config.password = password;
+    if (password_changed) {
+      _config.password = password;
+    }
   }
 
   {  // submit
@@ -437,10 +549,6 @@ auto Ui::configWidget() -> void {
     static std::string err_msg;
     if (ImGui::Button("Ready!", ImVec2(-1, 0))) {
       auto err = validConfig(_config);
-      bool valid_url = std::regex_match(
-          _config.protocol + "://" + _config.host + ":" + _config.port,
-          URL_REGEX);
-
       if (err.has_value() || !valid_url) {
         err_msg = "Error: " + err.value_or("Invalid URL");
         ImGui::SetNextWindowPos(ImVec2(0, 0), ImGuiCond_Appearing,
@@ -450,7 +558,7 @@ auto Ui::configWidget() -> void {
         ImGui::OpenPopup(err_popup_id);
       } else {
         sendToSrun(RequestLoadConfig{.config = _config});
-        sendToSrun(RequestLogin{});
+        sendToSrun(RequestLogin{.cancel = newOperation()});
         toWaiting("Connecting...", true, [this]() { configWidget(); });
       }
     }
@@ -468,41 +576,99 @@ auto Ui::configWidget() -> void {
 
 auto Ui::infoWidget() -> void {
   {
-    ImGui::Text("Username: %s", _user_info.username.c_str());
-    ImGui::Text("Online IP: %s", _user_info.online_ip.c_str());
-    ImGui::Text("MAC: %s", _user_info.mac.c_str());
-    ImGui::Text("Wallet Balance: %.2f", _user_info.wallet_balance);
-    ImGui::Text("Remain Seconds: %zu", _user_info.remain_seconds);
-    ImGui::Text("Sum Seconds: %zu", _user_info.sum_seconds);
-    ImGui::Text("In Bytes: %zu", _user_info.in_bytes);
+    if (_user_info_dirty) {
+      _user_info_text = std::format(
+          "Username: {}\nOnline IP: {}\nMAC: {}\nWallet Balance: {:.2f}\n"
+          "Remain Seconds: {}\nSum Seconds: {}\nIn Bytes: {}",
+          _user_info.username, _user_info.online_ip, _user_info.mac,
+          _user_info.wallet_balance, _user_info.remain_seconds,
+          _user_info.sum_seconds, _user_info.in_bytes);
+      _user_info_dirty = false;
+    }
+    ImGui::TextUnformatted(_user_info_text.data(),
+                           _user_info_text.data() + _user_info_text.size());
   }
   if (ImGui::Button("Logout", ImVec2(-1, 0))) {
-    sendToSrun(RequestLogout{});
+    sendToSrun(RequestLogout{.cancel = newOperation()});
     toWaiting("Logout...", false, [this]() { infoWidget(); });
   }
 
-  // TODO(franzero): Add refresh button
+  // Refreshing runs alongside the other requests instead of blocking the
+  // ui in the waiting state.
+  auto refreshing =
+      _refresh_call.has_value() && _calls.contains(*_refresh_call);
+  ImGui::BeginDisabled(refreshing);
   if (ImGui::Button("Refresh", ImVec2(-1, 0))) {
-    sendToSrun(RequestInfo{});
-    toWaiting("Getting user info...", false, [this]() { infoWidget(); });
+    _refresh_call =
+        callSrun<DrawInfo>(RequestInfo{}, [this](const DrawInfo& msg) {
+          if (msg.err_msg.has_value()) {
+            std::cerr << "Ui Error: " << msg.err_msg.value() << "\n";
+            return;
+          }
+
+          updateUserInfo(msg.user_info);
+        });
+  }
+  ImGui::EndDisabled();
+}
+
+static auto accountState(const DrawAccount& msg) -> const char* {
+  if (const auto* login = std::get_if<DrawLogin>(&msg.update)) {
+    if (login->err_msg.has_value()) {
+      return "login failed";
+    }
+    return login->finished ? "online" : "logging in";
   }
-  if (ImGui::IsItemHovered()) {
-    ImGui::BeginTooltip();
-    ImGui::Text("Not implemented yet");
-    ImGui::EndTooltip();
+
+  if (const auto* info = std::get_if<DrawInfo>(&msg.update)) {
+    return info->err_msg.has_value() ? "info failed" : "online";
+  }
+
+  if (const auto* logout = std::get_if<DrawLogout>(&msg.update)) {
+    return logout->err_msg.has_value() ? "logout failed" : "offline";
   }
+
+  return "added";
 }
 
-constexpr auto Ui::popupId(Ui::PopupType type) -> const char* {
-  switch (type) {
-    case PopupType::Error:
-      return "Error";
-    case PopupType::Warning:
-      return "Warning";
-    case PopupType::Info:
-      return "Info";
-    default:
-      return "Unknown";
+static auto accountError(const DrawAccount& msg) -> const std::string* {
+  return std::visit(
+      [](const auto& update) -> const std::string* {
+        if constexpr (requires { update.err_msg; }) {
+          return update.err_msg.has_value() ? &update.err_msg.value()
+                                            : nullptr;
+        } else {
+          return nullptr;
+        }
+      },
+      msg.update);
+}
+
+auto Ui::accountsWidget() -> void {
+  if (_accounts.empty() || !ImGui::CollapsingHeader("Accounts")) {
+    return;
+  }
+
+  for (const auto& [account, msg] : _accounts) {
+    ImGui::PushID(account.c_str());
+    ImGui::Text("%s: %s", account.c_str(), accountState(msg));
+    if (const auto* err_msg = accountError(msg)) {
+      ImGui::SetItemTooltip("%s", err_msg->c_str());
+    }
+
+    ImGui::SameLine();
+    if (ImGui::SmallButton("Login")) {
+      sendToSrun(RequestAccountLogin{.account = account, .cancel = {}});
+    }
+    ImGui::SameLine();
+    if (ImGui::SmallButton("Info")) {
+      sendToSrun(RequestAccountInfo{.account = account, .cancel = {}});
+    }
+    ImGui::SameLine();
+    if (ImGui::SmallButton("Logout")) {
+      sendToSrun(RequestAccountLogout{.account = account, .cancel = {}});
+    }
+    ImGui::PopID();
   }
 }
 
@@ -538,6 +704,24 @@ auto Ui::validConfig(const Config& config) -> std::optional<std::string> {
   return std::nullopt;
 }
 
+auto Ui::syncPolling() -> void {
+  auto polling = _state == &Ui::drawInfo && !_background;
+  if (polling == _polling_on && _hidden == _polling_hidden) {
+    return;
+  }
+
+  if (!polling) {
+    _polling.cancel();
+  } else {
+    if (!_polling_on) {
+      _polling = CancelSource{};
+    }
+    sendToSrun(RequestPollInfo{.hidden = _hidden, .cancel = _polling.token()});
+  }
+  _polling_on = polling;
+  _polling_hidden = _hidden;
+}
+
 auto Ui::toWaiting(std::string_view overlap, bool waiting_enable_cancel,
                    std::function<void()> disable_widget) -> void {
   waiting_overlay_text = overlap;
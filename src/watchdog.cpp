@@ -0,0 +1,84 @@
+#include "watchdog.h"
+
+#include <algorithm>
+
+namespace srun_gui {
+
+Watchdog::Watchdog(WatchdogOptions options) { setOptions(options); }
+
+auto Watchdog::setOptions(WatchdogOptions options) -> void {
+  _options = options;
+  _options.breaker_threshold =
+      std::max<std::size_t>(_options.breaker_threshold, 1);
+}
+
+auto Watchdog::start(Clock::time_point now) -> Clock::duration {
+  _action = Action::CheckOnline;
+  _failures = 0;
+  _last_online = now;
+  return jittered(_options.check_interval);
+}
+
+auto Watchdog::stop() -> void {
+  _action = Action::None;
+  _failures = 0;
+}
+
+auto Watchdog::onCheck(bool online, Clock::time_point now)
+    -> Clock::duration {
+  if (online) {
+    _last_online = now;
+    return jittered(_options.check_interval);
+  }
+
+  _action = Action::Login;
+  _failures = 0;
+  _detected_at = now;
+  {
+    std::scoped_lock lock{_metrics_mutex};
+    ++_metrics.drops;
+    _metrics.last_time_to_detect = now - _last_online;
+  }
+  return Clock::duration::zero();
+}
+
+auto Watchdog::onLogin(bool ok, Clock::time_point now) -> Clock::duration {
+  if (ok) {
+    {
+      std::scoped_lock lock{_metrics_mutex};
+      ++_metrics.recoveries;
+      _metrics.last_time_to_recover = now - _detected_at;
+      _metrics.total_time_to_recover += now - _detected_at;
+    }
+    return start(now);
+  }
+
+  ++_failures;
+  std::scoped_lock lock{_metrics_mutex};
+  ++_metrics.failed_logins;
+  if (_failures == _options.breaker_threshold) {
+    ++_metrics.breaker_trips;
+  }
+  return breakerOpen() ? jittered(_options.breaker_cooldown) : backoff();
+}
+
+auto Watchdog::metrics() const -> WatchdogMetrics {
+  std::scoped_lock lock{_metrics_mutex};
+  return _metrics;
+}
+
+auto Watchdog::backoff() -> Clock::duration {
+  Clock::duration delay = _options.retry_base;
+  for (std::size_t i = 1; i < _failures && delay < _options.retry_max; ++i) {
+    delay *= 2;
+  }
+  return jittered(std::min<Clock::duration>(delay, _options.retry_max));
+}
+
+auto Watchdog::jittered(Clock::duration delay) -> Clock::duration {
+  std::uniform_real_distribution<double> scale{1.0 - _options.jitter,
+                                               1.0 + _options.jitter};
+  return std::chrono::duration_cast<Clock::duration>(delay * scale(_rng));
+}
+
+}  // namespace srun_gui